@@ -0,0 +1,109 @@
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include "alloc.h"
+
+/*
+Replaces the allocator of the process to count calls and requested bytes, then forwards to
+glibc. glibc sends its own allocations through the replacement as well. Sanitizer builds
+bring their own allocator, ALLOC_COUNT is not defined for them and nothing is counted.
+*/
+static unsigned long long allocCalls;
+static unsigned long long allocBytes;
+
+#ifdef ALLOC_COUNT
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+/*
+*/
+static void alloc_note(size_t size)
+{
+    __atomic_add_fetch(&allocCalls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&allocBytes, size, __ATOMIC_RELAXED);
+}
+
+/*
+*/
+void *malloc(size_t size)
+{
+    alloc_note(size);
+
+    return __libc_malloc(size);
+}
+
+/*
+*/
+void *calloc(size_t nmemb, size_t size)
+{
+    alloc_note(nmemb * size);
+
+    return __libc_calloc(nmemb, size);
+}
+
+/*
+A realloc that moves or grows a block counts as an allocation, as it may copy.
+*/
+void *realloc(void *ptr, size_t size)
+{
+    alloc_note(size);
+
+    return __libc_realloc(ptr, size);
+}
+
+/*
+*/
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *ptr;
+
+    alloc_note(size);
+
+    if ((ptr = __libc_memalign(alignment, size)) == NULL)
+        return ENOMEM;
+
+    *memptr = ptr;
+
+    return 0;
+}
+
+/*
+*/
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    alloc_note(size);
+
+    return __libc_memalign(alignment, size);
+}
+
+/*
+*/
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+#endif
+
+/*
+*/
+int alloc_counting(void)
+{
+#ifdef ALLOC_COUNT
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/*
+*/
+void alloc_read(struct allocCount *count)
+{
+    count->calls = __atomic_load_n(&allocCalls, __ATOMIC_RELAXED);
+    count->bytes = __atomic_load_n(&allocBytes, __ATOMIC_RELAXED);
+}
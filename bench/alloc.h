@@ -0,0 +1,14 @@
+#ifndef BENCH_ALLOC_H
+#define BENCH_ALLOC_H
+
+/* heap use of the whole process, libcurl and OpenSSL included, counted since it started */
+struct allocCount
+{
+    unsigned long long calls;
+    unsigned long long bytes;
+};
+
+int alloc_counting(void);
+void alloc_read(struct allocCount *count);
+
+#endif
@@ -0,0 +1,371 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include <curl/curl.h>
+#include "alloc.h"
+#include "mock.h"
+
+/*
+Polls item keys through the handlers zbx_module_item_list() returns, the way the agent does,
+and reports per key the throughput, latency percentiles and heap allocations per poll.
+
+    usage: bench [-n polls] [-w warmup] [-a seconds] [-m mode] [-C control] [-l label] [-H] [-v] key...
+
+Keys use the item key syntax, glassfish.resource[http,DerbyPool,numconnused,current]. Every
+round polls each key once. -a moves the clock of the module forward by that many seconds
+after every round, so that cached responses expire and every poll goes to the server; -m
+switches the mock server to a mode, "delay=50&chunked=1" for instance, see mock_glassfish.py.
+Throughput is polls per second of time spent in the handlers, not of wall time. -H prints a
+header line, -v the values the warmup polls return and the warnings of the module.
+*/
+extern double benchClockSkew;
+
+struct benchKey
+{
+    char *text;
+    AGENT_REQUEST request;
+    ZBX_METRIC *metric;
+    double *latencies;
+    int polls;
+    int failures;
+    struct allocCount allocs;
+};
+
+static int verbose;
+
+/*
+Splits an item key into its name and parameters; quoted parameters may hold commas and
+escaped quotes. Returns FAIL on a key that does not parse.
+*/
+static int bench_parse_key(const char *text, AGENT_REQUEST *request)
+{
+    const char *p;
+    char *param = NULL;
+    size_t paramAlloc = 0, paramOffset = 0;
+
+    memset(request, 0, sizeof(*request));
+
+    if ((p = strchr(text, '[')) == NULL)
+    {
+        request->key = zbx_strdup(NULL, text);
+        return SUCCEED;
+    }
+
+    if (text[strlen(text) - 1] != ']')
+        return FAIL;
+
+    request->key = zbx_dsprintf(NULL, "%.*s", (int)(p - text), text);
+    request->params = (char **)zbx_malloc(NULL, sizeof(char *) * (strlen(text) + 1));
+
+    for (p++; ; p++)
+    {
+        while (*p == ' ')
+            p++;
+
+        zbx_strcpy_alloc(&param, &paramAlloc, &paramOffset, "");
+
+        if (*p == '"')
+        {
+            for (p++; *p != '"'; p++)
+            {
+                if (*p == '\0')
+                    return FAIL;
+
+                if (*p == '\\' && p[1] == '"')
+                    p++;
+
+                zbx_chrcpy_alloc(&param, &paramAlloc, &paramOffset, *p);
+            }
+
+            p++;
+
+            while (*p == ' ')
+                p++;
+        }
+        else
+        {
+            for (; *p != ',' && *p != ']' && *p != '\0'; p++)
+                zbx_chrcpy_alloc(&param, &paramAlloc, &paramOffset, *p);
+
+            zbx_rtrim(param, " ");
+        }
+
+        if (*p != ',' && *p != ']')
+            return FAIL;
+
+        request->params[request->nparam++] = param;
+        param = NULL;
+        paramAlloc = paramOffset = 0;
+
+        if (*p == ']')
+            break;
+    }
+
+    return (p[1] == '\0' ? SUCCEED : FAIL);
+}
+
+/*
+*/
+static int bench_compare(const void *d1, const void *d2)
+{
+    double a = *(const double *)d1, b = *(const double *)d2;
+
+    return (a < b ? -1 : a > b);
+}
+
+/*
+*/
+static double bench_percentile(const double *sorted, int count, double percentile)
+{
+    int index;
+
+    if (count == 0)
+        return 0;
+
+    index = (int)(percentile / 100 * count + 0.5) - 1;
+
+    return sorted[index < 0 ? 0 : (index >= count ? count - 1 : index)];
+}
+
+/*
+Performs one poll of the key as the agent would, result freed afterwards. Returns the time
+it took in seconds.
+*/
+static double bench_poll(struct benchKey *key, int record)
+{
+    AGENT_RESULT result;
+    struct allocCount before, after;
+    double started, elapsed;
+    int ret;
+
+    memset(&result, 0, sizeof(result));
+
+    alloc_read(&before);
+    started = zbx_time();
+    ret = key->metric->function(&key->request, &result);
+    elapsed = zbx_time() - started;
+    alloc_read(&after);
+
+    if (verbose != 0 && (record == 0 || ret != SYSINFO_RET_OK))
+    {
+        if ((result.type & AR_MESSAGE) != 0)
+            fprintf(stderr, "%s: failed: %s\n", key->text, result.msg);
+        else if ((result.type & AR_UINT64) != 0)
+            fprintf(stderr, "%s: " ZBX_FS_UI64 "\n", key->text, result.ui64);
+        else if ((result.type & AR_DOUBLE) != 0)
+            fprintf(stderr, "%s: %f\n", key->text, result.dbl);
+        else if ((result.type & (AR_STRING | AR_TEXT)) != 0)
+            fprintf(stderr, "%s: %.200s\n", key->text, (result.type & AR_STRING) != 0 ? result.str : result.text);
+    }
+
+    free(result.str);
+    free(result.text);
+    free(result.msg);
+
+    if (record != 0)
+    {
+        key->latencies[key->polls++] = elapsed;
+        key->failures += (ret != SYSINFO_RET_OK);
+        key->allocs.calls += after.calls - before.calls;
+        key->allocs.bytes += after.bytes - before.bytes;
+    }
+
+    return elapsed;
+}
+
+/*
+*/
+static void bench_report(const char *label, const char *name, double *latencies, int polls, int failures,
+                         const struct allocCount *allocs)
+{
+    double busy = 0;
+    char allocText[32], bytesText[32];
+    int i;
+
+    for (i = 0; i < polls; i++)
+        busy += latencies[i];
+
+    qsort(latencies, (size_t)polls, sizeof(double), bench_compare);
+
+    if (alloc_counting() != 0 && polls != 0)
+    {
+        zbx_snprintf(allocText, sizeof(allocText), "%.1f", (double)allocs->calls / polls);
+        zbx_snprintf(bytesText, sizeof(bytesText), "%.1f", (double)allocs->bytes / polls / 1024);
+    }
+    else
+    {
+        zbx_strlcpy(allocText, "-", sizeof(allocText));
+        zbx_strlcpy(bytesText, "-", sizeof(bytesText));
+    }
+
+    printf("%-12s %-60.60s %6d %5d %10.0f %8.3f %8.3f %8.3f %8.3f %8s %8s\n", label, name, polls, failures,
+           busy > 0 ? polls / busy : 0, bench_percentile(latencies, polls, 50) * 1000,
+           bench_percentile(latencies, polls, 90) * 1000, bench_percentile(latencies, polls, 99) * 1000,
+           polls != 0 ? latencies[polls - 1] * 1000 : 0, allocText, bytesText);
+}
+
+/*
+*/
+static void bench_usage(void)
+{
+    fprintf(stderr, "usage: bench [-n polls] [-w warmup] [-a seconds] [-m mode] [-C control] [-l label] [-H] [-v] key...\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    struct benchKey *keys;
+    struct allocCount allocs;
+    ZBX_METRIC *metrics;
+    const char *label = "bench", *mode = NULL, *control = "http://127.0.0.1:18080";
+    char *stats = NULL;
+    double *all, advance = 0;
+    int polls = 1000, warmup = 10, header = 0, count, failures = 0, total = 0, i, k, opt;
+
+    while ((opt = getopt(argc, argv, "n:w:a:m:C:l:Hv")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                polls = atoi(optarg);
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            case 'a':
+                advance = atof(optarg);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            case 'C':
+                control = optarg;
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            case 'H':
+                header = 1;
+                break;
+            case 'v':
+                verbose = 1;
+                benchLogLevel = LOG_LEVEL_WARNING;
+                break;
+            default:
+                bench_usage();
+        }
+    }
+
+    if (optind >= argc || polls <= 0)
+        bench_usage();
+
+    if (verbose == 0)
+        benchLogLevel = LOG_LEVEL_ERR;
+
+    if (zbx_module_init() != ZBX_MODULE_OK)
+    {
+        fprintf(stderr, "bench: zbx_module_init failed\n");
+        return EXIT_FAILURE;
+    }
+
+    metrics = zbx_module_item_list();
+    count = argc - optind;
+    keys = (struct benchKey *)zbx_calloc(NULL, (size_t)count, sizeof(struct benchKey));
+
+    for (k = 0; k < count; k++)
+    {
+        keys[k].text = argv[optind + k];
+
+        if (bench_parse_key(keys[k].text, &keys[k].request) != SUCCEED)
+        {
+            fprintf(stderr, "bench: cannot parse item key %s\n", keys[k].text);
+            return EXIT_FAILURE;
+        }
+
+        for (keys[k].metric = metrics; keys[k].metric->key != NULL; keys[k].metric++)
+        {
+            if (strcmp(keys[k].metric->key, keys[k].request.key) == 0)
+                break;
+        }
+
+        if (keys[k].metric->key == NULL)
+        {
+            fprintf(stderr, "bench: the module has no item key %s\n", keys[k].request.key);
+            return EXIT_FAILURE;
+        }
+
+        keys[k].latencies = (double *)zbx_malloc(NULL, sizeof(double) * (size_t)polls);
+    }
+
+    if (mock_reset(control, mode) != SUCCEED)
+        return EXIT_FAILURE;
+
+    for (i = 0; i < warmup; i++)
+    {
+        for (k = 0; k < count; k++)
+            bench_poll(&keys[k], 0);
+
+        benchClockSkew += advance;
+    }
+
+    /* the server counts the measured rounds only */
+    mock_control(control, "/__stats", &stats);
+    zbx_free(stats);
+
+    for (i = 0; i < polls; i++)
+    {
+        for (k = 0; k < count; k++)
+            bench_poll(&keys[k], 1);
+
+        benchClockSkew += advance;
+    }
+
+    mock_control(control, "/__stats", &stats);
+
+    if (header != 0)
+    {
+        printf("%-12s %-60s %6s %5s %10s %8s %8s %8s %8s %8s %8s\n", "scenario", "key", "polls", "fail",
+               "polls/s", "p50 ms", "p90 ms", "p99 ms", "max ms", "allocs", "KiB");
+    }
+
+    all = (double *)zbx_malloc(NULL, sizeof(double) * (size_t)polls * (size_t)count);
+    memset(&allocs, 0, sizeof(allocs));
+
+    for (k = 0; k < count; k++)
+    {
+        memcpy(all + total, keys[k].latencies, sizeof(double) * (size_t)keys[k].polls);
+        total += keys[k].polls;
+        failures += keys[k].failures;
+        allocs.calls += keys[k].allocs.calls;
+        allocs.bytes += keys[k].allocs.bytes;
+
+        if (count > 1)
+            bench_report(label, keys[k].text, keys[k].latencies, keys[k].polls, keys[k].failures, &keys[k].allocs);
+    }
+
+    bench_report(label, count > 1 ? "all keys" : keys[0].text, all, total, failures, &allocs);
+
+    printf("%-12s server: %lu requests, %lu connections, %lu TLS connections, %lu gzip, %lu chunked, "
+           "%lu not modified, %lu errors\n", label, mock_stat(stats, "requests"), mock_stat(stats, "connections"),
+           mock_stat(stats, "tls_connections"), mock_stat(stats, "gzip"), mock_stat(stats, "chunked"),
+           mock_stat(stats, "not_modified"), mock_stat(stats, "errors"));
+
+    zbx_free(stats);
+    zbx_free(all);
+
+    for (k = 0; k < count; k++)
+    {
+        for (i = 0; i < keys[k].request.nparam; i++)
+            zbx_free(keys[k].request.params[i]);
+
+        zbx_free(keys[k].request.params);
+        zbx_free(keys[k].request.key);
+        zbx_free(keys[k].latencies);
+    }
+
+    zbx_free(keys);
+    zbx_module_uninit();
+
+    return EXIT_SUCCESS;
+}
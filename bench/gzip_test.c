@@ -0,0 +1,161 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "mock.h"
+
+/*
+Checks that the module asks for compressed bodies and reads them correctly, against
+mock_glassfish.py over HTTP and HTTPS: the mock has to have sent gzip, the items have to
+return the values of the payloads, and glassfish.stats has to count the bytes compression
+saved. With compression switched off in the mock the values must not change and nothing
+more may be counted as saved.
+
+    usage: gzip_test [http-control [https-control]]
+*/
+extern double benchClockSkew;
+
+static ZBX_METRIC *metrics;
+static int failures;
+
+/*
+*/
+static void gzip_check(int passed, const char *profile, const char *what)
+{
+    printf("%s %s: %s\n", passed != 0 ? "ok  " : "FAIL", profile, what);
+    failures += (passed == 0);
+}
+
+/*
+Polls key with the given parameters as the agent would. Returns the numeric result, -1 if
+the poll failed.
+*/
+static double gzip_poll(const char *key, const char *p0, const char *p1, const char *p2, const char *p3)
+{
+    AGENT_REQUEST request;
+    AGENT_RESULT result;
+    ZBX_METRIC *metric;
+    char *params[] = {(char *)p0, (char *)p1, (char *)p2, (char *)p3};
+    double value = -1;
+
+    for (metric = metrics; metric->key != NULL && strcmp(metric->key, key) != 0; metric++)
+        ;
+
+    if (metric->key == NULL)
+        return -1;
+
+    memset(&request, 0, sizeof(request));
+    memset(&result, 0, sizeof(result));
+    request.key = (char *)key;
+    request.params = params;
+
+    while (request.nparam < 4 && params[request.nparam] != NULL)
+        request.nparam++;
+
+    if (metric->function(&request, &result) == SYSINFO_RET_OK)
+    {
+        if ((result.type & AR_UINT64) != 0)
+            value = (double)result.ui64;
+        else if ((result.type & AR_DOUBLE) != 0)
+            value = result.dbl;
+    }
+    else
+        fprintf(stderr, "%s[%s]: %s\n", key, p0, result.msg != NULL ? result.msg : "failed");
+
+    free(result.str);
+    free(result.text);
+    free(result.msg);
+
+    return value;
+}
+
+/*
+Polls the items of the profile once, with the response cache expired first, and checks the
+values against the payloads.
+*/
+static void gzip_poll_items(const char *profile, const char *mode)
+{
+    char *what;
+
+    benchClockSkew += 60;
+
+    what = zbx_dsprintf(NULL, "%s, field value", mode);
+    gzip_check(gzip_poll("glassfish.resource", profile, "DerbyPool", "numconnused", "current") == 3, profile, what);
+    zbx_free(what);
+
+    what = zbx_dsprintf(NULL, "%s, JSON path value", mode);
+    gzip_check(gzip_poll("glassfish.resource", profile, "DerbyPool", "numconnfree",
+                         "extraProperties.entity.numconnfree.current") == 9, profile, what);
+    zbx_free(what);
+
+    what = zbx_dsprintf(NULL, "%s, regex value", mode);
+    gzip_check(gzip_poll("glassfish.http.service", profile, "count200", "count.:(\\d+),", NULL) == 1000, profile,
+               what);
+    zbx_free(what);
+}
+
+/*
+*/
+static void gzip_test(const char *profile, const char *control)
+{
+    char *stats = NULL;
+    double saved, bytes;
+
+    /* padded bodies, large enough for compression to matter */
+    if (mock_reset(control, "pad=64") != SUCCEED)
+    {
+        gzip_check(0, profile, "mock server reachable");
+        return;
+    }
+
+    saved = gzip_poll("glassfish.stats", "bytes_saved", "", "resource", NULL);
+    gzip_poll_items(profile, "gzip");
+    mock_control(control, "/__stats", &stats);
+
+    gzip_check(mock_stat(stats, "requests") > 0 && mock_stat(stats, "gzip") == mock_stat(stats, "requests"), profile,
+               "every response compressed");
+    zbx_free(stats);
+
+    bytes = gzip_poll("glassfish.stats", "bytes", "", "resource", NULL);
+    gzip_check(gzip_poll("glassfish.stats", "bytes_saved", "", "resource", NULL) > saved + 32 * ZBX_KIBIBYTE,
+               profile, "bytes saved counted");
+
+    /* no ETag, a 304 would leave nothing to compare */
+    mock_reset(control, "pad=64&gzip=0&etag=0");
+    saved = gzip_poll("glassfish.stats", "bytes_saved", "", "resource", NULL);
+    gzip_poll_items(profile, "identity");
+    mock_control(control, "/__stats", &stats);
+
+    gzip_check(mock_stat(stats, "requests") > 0 && mock_stat(stats, "gzip") == 0, profile, "no response compressed");
+    zbx_free(stats);
+
+    gzip_check(gzip_poll("glassfish.stats", "bytes_saved", "", "resource", NULL) == saved, profile,
+               "nothing counted as saved");
+    gzip_check(gzip_poll("glassfish.stats", "bytes", "", "resource", NULL) - bytes > 64 * ZBX_KIBIBYTE, profile,
+               "whole body received");
+}
+
+int main(int argc, char **argv)
+{
+    const char *httpControl = (argc > 1 ? argv[1] : "http://127.0.0.1:18080");
+    const char *httpsControl = (argc > 2 ? argv[2] : httpControl);
+
+    benchLogLevel = LOG_LEVEL_ERR;
+
+    if (zbx_module_init() != ZBX_MODULE_OK)
+    {
+        fprintf(stderr, "gzip_test: zbx_module_init failed\n");
+        return EXIT_FAILURE;
+    }
+
+    metrics = zbx_module_item_list();
+
+    gzip_test("http", httpControl);
+    gzip_test("https", httpsControl);
+
+    zbx_module_uninit();
+
+    printf("%s\n", failures == 0 ? "passed" : "FAILED");
+
+    return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
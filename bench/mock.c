@@ -0,0 +1,106 @@
+#include "sysinc.h"
+#include "common.h"
+#include <curl/curl.h>
+#include "mock.h"
+
+/*
+*/
+static size_t mock_control_write(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t length = size * nmemb;
+    char **out = (char **)userp;
+    size_t alloc = 0, offset = 0;
+
+    if (*out != NULL)
+    {
+        offset = strlen(*out);
+        alloc = offset + 1;
+    }
+
+    zbx_strncpy_alloc(out, &alloc, &offset, (const char *)contents, length);
+
+    return length;
+}
+
+/*
+Sends a request to the control interface of the mock server, the response is written to
+out if it is not NULL.
+*/
+int mock_control(const char *control, const char *path, char **out)
+{
+    CURL *handle;
+    char *url, *body = NULL;
+    long status = 0;
+    CURLcode res;
+
+    if ((handle = curl_easy_init()) == NULL)
+        return FAIL;
+
+    url = zbx_dsprintf(NULL, "%s%s", control, path);
+    curl_easy_setopt(handle, CURLOPT_URL, url);
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, 10L);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, mock_control_write);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void *)&body);
+
+    if ((res = curl_easy_perform(handle)) == CURLE_OK)
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+
+    curl_easy_cleanup(handle);
+    zbx_free(url);
+
+    if (res != CURLE_OK || status != 200)
+    {
+        fprintf(stderr, "mock server at %s did not accept %s: %s\n", control, path,
+                res != CURLE_OK ? curl_easy_strerror(res) : "bad request");
+        zbx_free(body);
+        return FAIL;
+    }
+
+    if (out != NULL)
+        *out = body;
+    else
+        zbx_free(body);
+
+    return SUCCEED;
+}
+
+/*
+Zeroes the counters of the mock server and sets its mode, "delay=50&chunked=1" for instance,
+the default mode if mode is NULL.
+*/
+int mock_reset(const char *control, const char *mode)
+{
+    char *path;
+    int ret;
+
+    if (mock_control(control, "/__reset", NULL) != SUCCEED)
+        return FAIL;
+
+    if (mode == NULL)
+        return SUCCEED;
+
+    path = zbx_dsprintf(NULL, "/__mode?%s", mode);
+    ret = mock_control(control, path, NULL);
+    zbx_free(path);
+
+    return ret;
+}
+
+/*
+Returns a counter of the /__stats document of the mock server, 0 if it has none.
+*/
+unsigned long mock_stat(const char *stats, const char *name)
+{
+    char *pattern;
+    const char *p;
+    unsigned long value = 0;
+
+    pattern = zbx_dsprintf(NULL, "\"%s\":", name);
+
+    if (stats != NULL && (p = strstr(stats, pattern)) != NULL)
+        value = strtoul(p + strlen(pattern), NULL, 10);
+
+    zbx_free(pattern);
+
+    return value;
+}
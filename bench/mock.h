@@ -0,0 +1,9 @@
+#ifndef BENCH_MOCK_H
+#define BENCH_MOCK_H
+
+/* client of the control interface of mock_glassfish.py, control is its base URL */
+int mock_control(const char *control, const char *path, char **out);
+int mock_reset(const char *control, const char *mode);
+unsigned long mock_stat(const char *stats, const char *name);
+
+#endif
@@ -0,0 +1,417 @@
+#!/usr/bin/env python3
+"""
+Mock of the GlassFish 4 REST monitoring interface for the benchmarks, on localhost only.
+
+Monitoring resources are answered from the recorded responses in payloads/ when there is one
+for the path and depth, and from a small model of a domain otherwise (three connection pools,
+two applications with two servlets each, the HTTP service and the JVM). Counters of the model
+advance with /__tick.
+
+The way responses are sent is switched at runtime, so one server covers every scenario:
+
+    /__mode?delay=MS            wait before answering (slow GlassFish)
+    /__mode?chunked=1&chunk=N   Transfer-Encoding: chunked, N bytes per chunk
+    /__mode?trickle=MS          wait between chunks (slow body)
+    /__mode?pad=KIB             add child resources until the body grows by KIB (large bodies)
+    /__mode?status=CODE         answer every monitoring request with CODE (errors)
+    /__mode?drop=1              close the connection without answering
+    /__mode?gzip=0              never compress, even if asked
+    /__mode?etag=0              send no ETag and ignore If-None-Match
+    /__reset                    default mode, counters zeroed
+    /__stats                    requests, connections, compressed and chunked responses
+    /__tick, /__restart         advance the counters, or reset them as a restart would
+
+    usage: mock_glassfish.py [--port 18080] [--tls-port 18443] [--cert FILE --key FILE]
+                             [--payloads DIR] [--record DIR]
+
+Without --cert a self-signed certificate is made with the openssl command. --record writes
+every modelled response to DIR under the name payloads/ uses, which is how the responses in
+payloads/ were made; responses captured from a real DAS can be dropped there the same way:
+
+    curl -u admin "https://das:4848/monitoring/domain/server/resources?depth=5" \\
+         > payloads/monitoring.domain.server.resources.depth5.json
+"""
+
+import argparse
+import gzip
+import hashlib
+import json
+import os
+import shutil
+import socket
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+START = 1500000000000
+POOLS = ["DerbyPool", "__TimerPool", "jdbc-app"]
+APPLICATIONS = ["app1", "app2"]
+SERVLETS = ["default", "jsp"]
+DEFAULT_MODE = {"delay": 0, "chunked": 0, "chunk": 1024, "trickle": 0, "pad": 0, "status": 0,
+                "drop": 0, "gzip": 1, "etag": 1}
+
+lock = threading.Lock()
+state = {"tick": 0, "start": START}
+mode = dict(DEFAULT_MODE)
+stats = {}
+options = None
+payloads = {}
+
+
+def reset_stats():
+    stats.clear()
+    stats.update({"requests": 0, "connections": 0, "tls_connections": 0, "gzip": 0, "chunked": 0,
+                  "not_modified": 0, "errors": 0, "dropped": 0, "bytes": 0, "paths": {}})
+
+
+def count(name, value=1):
+    with lock:
+        stats[name] += value
+
+
+def count_statistic(name, value):
+    return {"count": value, "lastsampletime": state["start"] + 1000 * state["tick"], "description": "",
+            "unit": "count", "name": name, "starttime": state["start"]}
+
+
+def range_statistic(name, value):
+    return {"current": value, "lowwatermark": 0, "highwatermark": value + 5, "lastsampletime": state["start"],
+            "description": "", "unit": "count", "name": name, "starttime": state["start"]}
+
+
+def bounded_statistic(name, value):
+    statistic = range_statistic(name, value)
+    statistic.update({"lowerbound": 0, "upperbound": 32})
+    return statistic
+
+
+def pool_entity(pool):
+    i = POOLS.index(pool) + 1
+    return {"numconnused": bounded_statistic("NumConnUsed", 3 * i),
+            "numconnfree": bounded_statistic("NumConnFree", 10 - i),
+            "averageconnwaittime": count_statistic("AverageConnWaitTime", 7 * i),
+            "numconncreated": count_statistic("NumConnCreated", 100 * i + state["tick"]),
+            "waitqueuelength": count_statistic("WaitQueueLength", 0)}
+
+
+def request_entity():
+    tick = state["tick"]
+    return {"count200": count_statistic("Count200", 1000 + 10 * tick),
+            "count404": count_statistic("Count404", 4),
+            "count500": count_statistic("Count500", 5),
+            "maxtime": count_statistic("MaxTime", 250),
+            "errorcount": count_statistic("ErrorCount", 9 + tick)}
+
+
+def application_entity(application):
+    i = APPLICATIONS.index(application) + 1
+    return {"activesessionscurrent": range_statistic("ActiveSessionsCurrent", 2 * i),
+            "sessionstotal": count_statistic("SessionsTotal", 50 * i + state["tick"]),
+            "servletprocessingtimes": count_statistic("ServletProcessingTimes", 11)}
+
+
+def servlet_entity(application, servlet):
+    return {"errorcount": count_statistic("ErrorCount", len(application) + len(servlet)),
+            "requestcount": count_statistic("RequestCount", 100 + state["tick"]),
+            "processingtime": count_statistic("ProcessingTime", 20)}
+
+
+def leaf(entity, rest, index):
+    """The entity itself, or the one statistic a path below it names."""
+    if len(rest) == index:
+        return entity, []
+    if len(rest) == index + 1 and rest[index] in entity:
+        return {rest[index]: entity[rest[index]]}, []
+    return None
+
+
+def node(path):
+    """Entity and child names of a monitoring resource of the model, or None."""
+    parts = [part for part in path.strip("/").split("/") if part]
+    if parts[:3] != ["monitoring", "domain", "server"]:
+        return None
+    rest = parts[3:]
+    if not rest:
+        return {}, ["resources", "applications", "http-service", "jvm"]
+    if rest == ["resources"]:
+        return {}, POOLS
+    if rest[0] == "resources" and rest[1] in POOLS:
+        return leaf(pool_entity(rest[1]), rest, 2)
+    if rest == ["http-service"]:
+        return {}, ["server"]
+    if rest == ["http-service", "server"]:
+        return {}, ["request"]
+    if rest[:3] == ["http-service", "server", "request"]:
+        return leaf(request_entity(), rest, 3)
+    if rest == ["applications"]:
+        return {}, APPLICATIONS
+    if rest[0] == "applications" and rest[1] in APPLICATIONS:
+        application = rest[1]
+        if len(rest) == 2:
+            return {}, ["server"]
+        if rest[2] != "server":
+            return None
+        if len(rest) == 4 and rest[3] in SERVLETS:
+            return servlet_entity(application, rest[3]), []
+        if len(rest) == 3:
+            return application_entity(application), SERVLETS
+        return leaf(application_entity(application), rest, 3)
+    if rest == ["jvm"]:
+        return {}, ["memory", "thread-system"]
+    if rest == ["jvm", "memory"]:
+        return {"usedheapsize-count": count_statistic("UsedHeapSize", 123456),
+                "maxheapsize-count": count_statistic("MaxHeapSize", 999999)}, []
+    if rest == ["jvm", "thread-system"]:
+        return {"threadcount": count_statistic("ThreadCount", 77)}, []
+    return None
+
+
+def render(path, depth, host):
+    found = node(path)
+    if found is None:
+        return None
+    entity, children = found
+    base = "http://%s/%s" % (host, path.strip("/"))
+    body = {"message": "", "command": "Monitoring Data", "exit_code": "SUCCESS",
+            "extraProperties": {"entity": entity,
+                                "childResources": {child: base + "/" + child for child in children}}}
+    if depth > 1 and children:
+        body["children"] = {}
+        for child in children:
+            below = render(path.rstrip("/") + "/" + child, depth - 1, host)
+            if below is not None:
+                for name in ("message", "command", "exit_code"):
+                    below.pop(name, None)
+                body["children"][child] = below
+    return body
+
+
+def payload_name(path, depth):
+    name = path.strip("/").replace("/", ".")
+    if depth > 1:
+        name += ".depth%d" % depth
+    return name + ".json"
+
+
+def load_payloads(directory):
+    if not directory or not os.path.isdir(directory):
+        return
+    for name in os.listdir(directory):
+        if name.endswith(".json"):
+            with open(os.path.join(directory, name), "rb") as f:
+                payloads[name] = f.read()
+
+
+def monitoring_body(path, depth, host):
+    name = payload_name(path, depth)
+    data = payloads.get(name)
+    if data is None:
+        body = render(path, depth, host)
+        if body is None:
+            return None
+        data = json.dumps(body, separators=(",", ":")).encode()
+        if options.record:
+            with open(os.path.join(options.record, name), "wb") as f:
+                f.write(data)
+    if mode["pad"] > 0:
+        data = pad(data, mode["pad"] * 1024)
+    return data
+
+
+def pad(data, size):
+    """Adds child resources, as a domain with many of them would have, until size bytes are added."""
+    body = json.loads(data)
+    children = body.setdefault("extraProperties", {}).setdefault("childResources", {})
+    added, i = 0, 0
+    while added < size:
+        name = "resource-%06d" % i
+        url = "http://localhost:4848/monitoring/domain/server/resources/" + name
+        children[name] = url
+        added += len(name) + len(url) + 6
+        i += 1
+    return json.dumps(body, separators=(",", ":")).encode()
+
+
+class MonitoringHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    disable_nagle_algorithm = True
+    server_version = "GlassFish Server Open Source Edition 4.1"
+    sys_version = ""
+
+    def log_message(self, *args):
+        pass
+
+    def setup(self):
+        BaseHTTPRequestHandler.setup(self)
+        count("tls_connections" if isinstance(self.connection, ssl.SSLSocket) else "connections")
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        query = parse_qs(url.query)
+
+        if url.path.startswith("/__"):
+            return self.control(url.path, query)
+
+        with lock:
+            stats["requests"] += 1
+            stats["paths"][url.path] = stats["paths"].get(url.path, 0) + 1
+
+        if mode["delay"]:
+            time.sleep(mode["delay"] / 1000.0)
+
+        if mode["drop"]:
+            count("dropped")
+            self.close_connection = True
+            self.connection.shutdown(socket.SHUT_RDWR)
+            return
+
+        if mode["status"]:
+            count("errors")
+            return self.reply(mode["status"], b'{"message":"mock failure","exit_code":"FAILURE"}')
+
+        if url.path.startswith("/management/domain/resources/ping-connection-pool"):
+            ok = query.get("id", [""])[0] in POOLS
+            body = {"message": "", "command": "Ping JDBC Connection Pool", "exit_code": "SUCCESS" if ok else "FAILURE"}
+            return self.reply(200 if ok else 500, json.dumps(body, separators=(",", ":")).encode())
+
+        depth = int(query.get("depth", ["1"])[0])
+        data = monitoring_body(url.path, depth, self.headers.get("Host", "localhost"))
+
+        if data is None:
+            count("errors")
+            return self.reply(404, b'{"message":"resource not found","exit_code":"FAILURE"}')
+
+        headers = {}
+        if mode["etag"]:
+            etag = '"%s"' % hashlib.md5(data).hexdigest()
+            headers["ETag"] = etag
+            if self.headers.get("If-None-Match") == etag:
+                count("not_modified")
+                return self.reply(304, b"", headers)
+
+        self.reply(200, data, headers)
+
+    def control(self, path, query):
+        global mode
+        if path == "/__stats":
+            with lock:
+                data = json.dumps(stats, separators=(",", ":"), sort_keys=True).encode()
+            return self.reply(200, data, compress=False)
+        if path == "/__reset":
+            with lock:
+                reset_stats()
+                mode = dict(DEFAULT_MODE)
+        elif path == "/__mode":
+            for name, values in query.items():
+                if name not in DEFAULT_MODE:
+                    return self.reply(400, b'{"message":"unknown mode"}', compress=False)
+                mode[name] = int(values[0])
+        elif path == "/__tick":
+            state["tick"] += 1
+        elif path == "/__restart":
+            state["start"] += 5000
+            state["tick"] = 0
+        else:
+            return self.reply(404, b"{}", compress=False)
+        self.reply(200, json.dumps(mode, separators=(",", ":"), sort_keys=True).encode(), compress=False)
+
+    def reply(self, status, data, headers=None, compress=True):
+        accepted = self.headers.get("Accept-Encoding") or ""
+        encoded = compress and mode["gzip"] and "gzip" in accepted and len(data) > 200
+
+        if encoded:
+            data = gzip.compress(data, 6)
+            count("gzip")
+
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        if encoded:
+            self.send_header("Content-Encoding", "gzip")
+        for name, value in (headers or {}).items():
+            self.send_header(name, value)
+
+        chunked = compress and mode["chunked"] and status != 304
+        if chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+        else:
+            self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+
+        if chunked:
+            count("chunked")
+            step = max(1, mode["chunk"])
+            for i in range(0, len(data), step):
+                piece = data[i:i + step]
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(piece), piece))
+                self.wfile.flush()
+                if mode["trickle"]:
+                    time.sleep(mode["trickle"] / 1000.0)
+            self.wfile.write(b"0\r\n\r\n")
+        else:
+            self.wfile.write(data)
+
+        count("bytes", len(data))
+
+
+def self_signed(directory):
+    cert = os.path.join(directory, "mock.crt")
+    key = os.path.join(directory, "mock.key")
+    subprocess.run(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "2",
+                    "-subj", "/CN=localhost", "-keyout", key, "-out", cert],
+                   check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return cert, key
+
+
+def main():
+    global options
+    parser = argparse.ArgumentParser(description="GlassFish REST monitoring mock for the benchmarks")
+    parser.add_argument("--port", type=int, default=18080)
+    parser.add_argument("--tls-port", type=int, default=18443, help="0 disables HTTPS")
+    parser.add_argument("--cert")
+    parser.add_argument("--key")
+    parser.add_argument("--payloads", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "payloads"))
+    parser.add_argument("--record")
+    options = parser.parse_args()
+
+    reset_stats()
+    load_payloads(options.payloads)
+
+    servers = [ThreadingHTTPServer(("127.0.0.1", options.port), MonitoringHandler)]
+    workdir = None
+
+    if options.tls_port:
+        cert, key = options.cert, options.key
+        if not cert:
+            workdir = tempfile.mkdtemp(prefix="mock_glassfish.")
+            cert, key = self_signed(workdir)
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(cert, key)
+        context.set_alpn_protocols(["http/1.1"])
+        tls = ThreadingHTTPServer(("127.0.0.1", options.tls_port), MonitoringHandler)
+        tls.socket = context.wrap_socket(tls.socket, server_side=True, do_handshake_on_connect=False)
+        servers.append(tls)
+
+    for server in servers:
+        server.daemon_threads = True
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    sys.stdout.write("mock_glassfish: http on %d, https on %s\n" % (options.port, options.tls_port or "-"))
+    sys.stdout.flush()
+
+    try:
+        while True:
+            time.sleep(3600)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if workdir:
+            shutil.rmtree(workdir, ignore_errors=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,278 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include "pcreposix.h"
+#include "zbxregexp.h"
+#include <dirent.h>
+#include <curl/curl.h>
+#include <pcre.h>
+#include "glassfish.h"
+#include "alloc.h"
+
+/*
+Compares the two ways of applying an item regex to a response: compiling the pattern on every
+call, as the module did before regexes were cached, and parse_data(), which takes the compiled
+and studied pattern from the cache of the fetch context. Each pattern runs over every captured
+response in the payload directory.
+
+    usage: regex_bench [-n calls] [-d payloads] [pattern...]
+
+Linked with -Wl,--wrap=pcre_compile, so that compilations are counted for the stand-in PCRE
+and for libpcre (make PCRE=1, where pcre_study() also JIT-compiles) alike.
+*/
+static const char *defaultPatterns[] =
+{
+    "count.:(\\d+),",
+    "current.:(-?\\d+),",
+    "\"numconnfree\":\\{\"current\":(\\d+)",
+    "usedheapsize-count.:\\{.count.:(\\d+)",
+    "exit_code.:.(\\w+).,",
+    NULL
+};
+
+struct regexPayload
+{
+    char *name;
+    char *data;
+};
+
+static unsigned long compiles;
+
+pcre *__real_pcre_compile(const char *pattern, int options, const char **errptr, int *erroffset,
+                          const unsigned char *tableptr);
+
+/*
+*/
+pcre *__wrap_pcre_compile(const char *pattern, int options, const char **errptr, int *erroffset,
+                          const unsigned char *tableptr)
+{
+    compiles++;
+
+    return __real_pcre_compile(pattern, options, errptr, erroffset, tableptr);
+}
+
+/*
+The first capture group of regex in data, the pattern compiled for this call only.
+*/
+static char *regex_match_uncached(const char *data, const char *regex)
+{
+    const char *errorStr, *match = NULL;
+    int errorOffset, ret, subStrVec[30];
+    char *result = NULL;
+    pcre *re;
+
+    if ((re = pcre_compile(regex, PCRE_MULTILINE, &errorStr, &errorOffset, 0)) == NULL)
+        return NULL;
+
+    ret = pcre_exec(re, NULL, data, (int)strlen(data), 0, 0, subStrVec, 30);
+
+    if (ret > REGEX_GROUP && pcre_get_substring(data, subStrVec, ret, REGEX_GROUP, &match) >= 0)
+    {
+        result = zbx_strdup(NULL, match);
+        pcre_free_substring(match);
+    }
+
+    pcre_free(re);
+
+    return result;
+}
+
+/*
+Reads the *.json files of directory, sorted by name. Returns their number.
+*/
+static int regex_load(const char *directory, struct regexPayload **payloads)
+{
+    struct dirent **entries;
+    char *path;
+    FILE *file;
+    long size;
+    int count, loaded = 0, i;
+
+    if ((count = scandir(directory, &entries, NULL, alphasort)) < 0)
+    {
+        fprintf(stderr, "regex_bench: cannot read %s: %s\n", directory, zbx_strerror(errno));
+        return 0;
+    }
+
+    *payloads = (struct regexPayload *)zbx_calloc(NULL, (size_t)count + 1, sizeof(struct regexPayload));
+
+    for (i = 0; i < count; i++)
+    {
+        size_t length = strlen(entries[i]->d_name);
+
+        if (length > 5 && strcmp(entries[i]->d_name + length - 5, ".json") == 0)
+        {
+            path = zbx_dsprintf(NULL, "%s/%s", directory, entries[i]->d_name);
+
+            if ((file = fopen(path, "rb")) != NULL)
+            {
+                fseek(file, 0, SEEK_END);
+                size = ftell(file);
+                rewind(file);
+
+                (*payloads)[loaded].data = (char *)zbx_malloc(NULL, (size_t)size + 1);
+                (*payloads)[loaded].data[fread((*payloads)[loaded].data, 1, (size_t)size, file)] = '\0';
+                (*payloads)[loaded].name = zbx_strdup(NULL, entries[i]->d_name);
+                loaded++;
+                fclose(file);
+            }
+
+            zbx_free(path);
+        }
+
+        free(entries[i]);
+    }
+
+    free(entries);
+
+    return loaded;
+}
+
+/*
+*/
+static void regex_report(const char *pattern, const char *mode, int calls, double seconds, unsigned long compileCount,
+                         const struct allocCount *allocs, double speedup)
+{
+    char allocText[32], speedupText[32];
+
+    if (alloc_counting() != 0)
+        zbx_snprintf(allocText, sizeof(allocText), "%.1f", (double)allocs->calls / calls);
+    else
+        zbx_strlcpy(allocText, "-", sizeof(allocText));
+
+    if (speedup > 0)
+        zbx_snprintf(speedupText, sizeof(speedupText), "%.1fx", speedup);
+    else
+        zbx_strlcpy(speedupText, "", sizeof(speedupText));
+
+    printf("%-40.40s %-9s %9d %10.0f %9lu %8s %8s\n", pattern, mode, calls, seconds / calls * 1e9, compileCount,
+           allocText, speedupText);
+}
+
+int main(int argc, char **argv)
+{
+    struct fetchContext *ctx;
+    struct regexPayload *payloads = NULL;
+    struct allocCount before, after, uncachedAllocs, cachedAllocs;
+    const char **patterns = defaultPatterns, *directory = "payloads";
+    double started, uncachedTime, cachedTime;
+    unsigned long uncachedCompiles, cachedCompiles;
+    char *uncached, *cached;
+    int calls = 2000, count, p, f, i, opt, matched, mismatches = 0;
+
+    while ((opt = getopt(argc, argv, "n:d:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                calls = atoi(optarg);
+                break;
+            case 'd':
+                directory = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: regex_bench [-n calls] [-d payloads] [pattern...]\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind < argc)
+        patterns = (const char **)argv + optind;
+
+    benchLogLevel = LOG_LEVEL_ERR;
+
+    if ((count = regex_load(directory, &payloads)) == 0 || calls <= 0)
+    {
+        fprintf(stderr, "regex_bench: no payloads in %s\n", directory);
+        return EXIT_FAILURE;
+    }
+
+    if (config_load() != SUCCEED || curl_init() != SUCCEED)
+        return EXIT_FAILURE;
+
+    stats_init();
+
+    if ((ctx = fetch_context_create()) == NULL)
+        return EXIT_FAILURE;
+
+    printf("%d payloads in %s, %d calls per payload and pattern\n", count, directory, calls);
+    printf("%-40s %-9s %9s %10s %9s %8s %8s\n", "pattern", "mode", "calls", "ns/call", "compiles", "allocs",
+           "speedup");
+
+    for (p = 0; patterns[p] != NULL; p++)
+    {
+        uncachedTime = cachedTime = 0;
+        uncachedCompiles = cachedCompiles = 0;
+        memset(&uncachedAllocs, 0, sizeof(uncachedAllocs));
+        memset(&cachedAllocs, 0, sizeof(cachedAllocs));
+        matched = 0;
+
+        for (f = 0; f < count; f++)
+        {
+            uncached = regex_match_uncached(payloads[f].data, patterns[p]);
+            cached = parse_data(ctx, payloads[f].data, patterns[p]);
+
+            if ((uncached == NULL) != (cached == NULL) || (uncached != NULL && strcmp(uncached, cached) != 0))
+            {
+                fprintf(stderr, "regex_bench: '%s' on %s: %s uncached, %s cached\n", patterns[p], payloads[f].name,
+                        uncached != NULL ? uncached : "no match", cached != NULL ? cached : "no match");
+                mismatches++;
+            }
+
+            matched += (cached != NULL);
+            zbx_free(uncached);
+            zbx_free(cached);
+
+            compiles = 0;
+            alloc_read(&before);
+            started = zbx_time();
+
+            for (i = 0; i < calls; i++)
+            {
+                uncached = regex_match_uncached(payloads[f].data, patterns[p]);
+                zbx_free(uncached);
+            }
+
+            uncachedTime += zbx_time() - started;
+            alloc_read(&after);
+            uncachedCompiles += compiles;
+            uncachedAllocs.calls += after.calls - before.calls;
+
+            compiles = 0;
+            alloc_read(&before);
+            started = zbx_time();
+
+            for (i = 0; i < calls; i++)
+            {
+                cached = parse_data(ctx, payloads[f].data, patterns[p]);
+                zbx_free(cached);
+            }
+
+            cachedTime += zbx_time() - started;
+            alloc_read(&after);
+            cachedCompiles += compiles;
+            cachedAllocs.calls += after.calls - before.calls;
+        }
+
+        regex_report(patterns[p], "compile", calls * count, uncachedTime, uncachedCompiles, &uncachedAllocs, 0);
+        regex_report(patterns[p], "cached", calls * count, cachedTime, cachedCompiles, &cachedAllocs,
+                     cachedTime > 0 ? uncachedTime / cachedTime : 0);
+        printf("%-40.40s matched %d of %d payloads\n", "", matched, count);
+    }
+
+    fetch_context_destroy(ctx);
+    curl_uninit();
+    config_destroy();
+
+    for (f = 0; f < count; f++)
+    {
+        zbx_free(payloads[f].name);
+        zbx_free(payloads[f].data);
+    }
+
+    zbx_free(payloads);
+
+    return (mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,185 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include <pthread.h>
+#include <curl/curl.h>
+#include "glassfish.h"
+#include "mock.h"
+
+/*
+Runs threads that each own a fetch context, as the collector and the item handlers do, and
+make requests through it at the same time against mock_glassfish.py: fetch_data() into the
+response buffer of the context, parse_data() with the regex cache of the context, and the
+value checked. Even threads use the http profile, odd ones https. A context keeps its
+connection, so the mock should see about one connection per thread.
+
+    usage: stress [-t threads] [-n requests] [-m mode] [-C control]
+
+Build with make SANITIZE=thread to have ThreadSanitizer watch the run.
+*/
+struct stressTarget
+{
+    const char *path;
+    const char *regex;
+    const char *expected;
+};
+
+struct stressThread
+{
+    pthread_t thread;
+    const struct targetProfile *profile;
+    int requests;
+    int passed;
+    int failed;
+};
+
+static const struct stressTarget targets[] =
+{
+    {"monitoring/domain/server/resources/DerbyPool",         "\"numconnused\":\\{\"current\":(\\d+)",        "3"},
+    {"monitoring/domain/server/jvm/memory",                  "usedheapsize-count.:\\{.count.:(\\d+)",        "123456"},
+    {"monitoring/domain/server/http-service/server/request", "count200.:\\{.count.:(\\d+)",                  "1000"},
+    {"monitoring/domain/server/applications/app2/server",    "activesessionscurrent.:\\{.current.:(\\d+)",   "4"}
+};
+
+/*
+*/
+static void *stress_thread(void *arg)
+{
+    struct stressThread *thread = (struct stressThread *)arg;
+    const struct stressTarget *target;
+    struct fetchContext *ctx;
+    char *url, *data, *value;
+    int i;
+
+    if ((ctx = fetch_context_create()) == NULL)
+    {
+        thread->failed = thread->requests;
+        return NULL;
+    }
+
+    for (i = 0; i < thread->requests; i++)
+    {
+        target = &targets[i % (int)(sizeof(targets) / sizeof(targets[0]))];
+        url = zbx_dsprintf(NULL, "%s:%s/%s", thread->profile->url, thread->profile->port, target->path);
+        value = NULL;
+
+        if ((data = fetch_data(ctx, url, thread->profile->user, thread->profile->password, thread->profile)) != NULL)
+            value = parse_data(ctx, data, target->regex);
+
+        if (value != NULL && strcmp(value, target->expected) == 0)
+            thread->passed++;
+        else
+        {
+            fprintf(stderr, "stress: %s: %s\n", url, data == NULL ? fetch_error(ctx, "request failed") :
+                    (value == NULL ? "no match" : value));
+            thread->failed++;
+        }
+
+        zbx_free(value);
+        zbx_free(data);
+        zbx_free(url);
+    }
+
+    fetch_context_destroy(ctx);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct stressThread *threads;
+    const struct targetProfile *http, *https;
+    const char *mode = NULL, *control = "http://127.0.0.1:18080";
+    char *stats = NULL;
+    double started, elapsed;
+    unsigned long connections, tlsConnections;
+    int threadCount = 16, requests = 500, passed = 0, failed = 0, i, opt;
+
+    while ((opt = getopt(argc, argv, "t:n:m:C:")) != -1)
+    {
+        switch (opt)
+        {
+            case 't':
+                threadCount = atoi(optarg);
+                break;
+            case 'n':
+                requests = atoi(optarg);
+                break;
+            case 'm':
+                mode = optarg;
+                break;
+            case 'C':
+                control = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: stress [-t threads] [-n requests] [-m mode] [-C control]\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    benchLogLevel = LOG_LEVEL_ERR;
+
+    if (threadCount <= 0 || requests <= 0 || zbx_module_init() != ZBX_MODULE_OK)
+        return EXIT_FAILURE;
+
+    if ((http = config_profile("http")) == NULL || (https = config_profile("https")) == NULL)
+    {
+        fprintf(stderr, "stress: the configuration needs the profiles http and https\n");
+        return EXIT_FAILURE;
+    }
+
+    if (mock_reset(control, mode) != SUCCEED)
+        return EXIT_FAILURE;
+
+    threads = (struct stressThread *)zbx_calloc(NULL, (size_t)threadCount, sizeof(struct stressThread));
+    started = zbx_time();
+
+    for (i = 0; i < threadCount; i++)
+    {
+        threads[i].profile = (i % 2 == 0 ? http : https);
+        threads[i].requests = requests;
+
+        if (pthread_create(&threads[i].thread, NULL, stress_thread, &threads[i]) != 0)
+        {
+            fprintf(stderr, "stress: cannot start thread %d: %s\n", i, zbx_strerror(errno));
+            threads[i].failed = requests;
+            threads[i].requests = 0;
+        }
+    }
+
+    for (i = 0; i < threadCount; i++)
+    {
+        if (threads[i].requests != 0)
+            pthread_join(threads[i].thread, NULL);
+
+        passed += threads[i].passed;
+        failed += threads[i].failed;
+    }
+
+    elapsed = zbx_time() - started;
+
+    mock_control(control, "/__stats", &stats);
+
+    /* /__stats, and /__mode if a mode was set, came after the counters were zeroed */
+    connections = mock_stat(stats, "connections") - (mode != NULL ? 2 : 1);
+    tlsConnections = mock_stat(stats, "tls_connections");
+    zbx_free(stats);
+
+    printf("%d threads, %d of %d requests passed, %.0f requests/s, %lu connections, %lu TLS connections\n",
+           threadCount, passed, passed + failed, (passed + failed) / elapsed, connections, tlsConnections);
+
+    if (connections + tlsConnections > (unsigned long)threadCount)
+    {
+        printf("FAILED: more connections than threads, contexts did not keep theirs\n");
+        failed++;
+    }
+
+    zbx_free(threads);
+    zbx_module_uninit();
+
+    printf("%s\n", failed == 0 ? "passed" : "FAILED");
+
+    return (failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,53 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+typedef uint64_t zbx_uint64_t;
+
+#define ZBX_FS_UI64             "%" PRIu64
+#define ZBX_FS_DBL              "%lf"
+#define SUCCEED                 0
+#define FAIL                    -1
+#define ZBX_KIBIBYTE            1024
+#define ZBX_MAX_UINT64          (~(zbx_uint64_t)0)
+#define ZBX_WHITESPACE          " \t\r\n"
+#define ZBX_CONST_STRLEN(s)     (sizeof(s) - 1)
+#define ZBX_UNUSED(var)         (void)(var)
+#define ZBX_JSON_TYPE_STRING    1
+#define ZBX_JSON_TYPE_INT       2
+#define ZBX_PROTO_TAG_DATA      "data"
+
+#define THIS_SHOULD_NEVER_HAPPEN    fprintf(stderr, "THIS_SHOULD_NEVER_HAPPEN %s:%d\n", __FILE__, __LINE__)
+
+#ifndef MIN
+#define MIN(a, b)               ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b)               ((a) > (b) ? (a) : (b))
+#endif
+
+#define zbx_free(p)             do { free(p); p = NULL; } while (0)
+#define zbx_malloc(old, size)   zbx_malloc2(__FILE__, __LINE__, old, size)
+#define zbx_calloc(old, n, size)    zbx_calloc2(__FILE__, __LINE__, old, n, size)
+#define zbx_realloc(src, size)  zbx_realloc2(__FILE__, __LINE__, src, size)
+#define zbx_strdup(old, str)    zbx_strdup2(__FILE__, __LINE__, old, str)
+
+void *zbx_malloc2(const char *filename, int line, void *old, size_t size);
+void *zbx_calloc2(const char *filename, int line, void *old, size_t nmemb, size_t size);
+void *zbx_realloc2(const char *filename, int line, void *old, size_t size);
+char *zbx_strdup2(const char *filename, int line, char *old, const char *str);
+
+size_t zbx_snprintf(char *str, size_t count, const char *fmt, ...);
+char *zbx_dsprintf(char *dest, const char *f, ...);
+void zbx_snprintf_alloc(char **str, size_t *alloc_len, size_t *offset, const char *fmt, ...);
+void zbx_strcpy_alloc(char **str, size_t *alloc_len, size_t *offset, const char *src);
+void zbx_strncpy_alloc(char **str, size_t *alloc_len, size_t *offset, const char *src, size_t n);
+void zbx_chrcpy_alloc(char **str, size_t *alloc_len, size_t *offset, char c);
+size_t zbx_strlcpy(char *dst, const char *src, size_t siz);
+void zbx_rtrim(char *str, const char *charlist);
+void zbx_ltrim(char *str, const char *charlist);
+void zbx_lrtrim(char *str, const char *charlist);
+int is_uint64(const char *str, zbx_uint64_t *value);
+const char *zbx_strerror(int errnum);
+double zbx_time(void);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef BENCH_LOG_H
+#define BENCH_LOG_H
+
+#define LOG_LEVEL_EMPTY         0
+#define LOG_LEVEL_CRIT          1
+#define LOG_LEVEL_ERR           2
+#define LOG_LEVEL_WARNING       3
+#define LOG_LEVEL_DEBUG         4
+#define LOG_LEVEL_TRACE         5
+#define LOG_LEVEL_INFORMATION   127
+
+/* messages up to this level are printed to stderr, LOG_LEVEL_INFORMATION ones only at LOG_LEVEL_DEBUG */
+extern int benchLogLevel;
+
+void __zbx_zabbix_log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define zabbix_log              __zbx_zabbix_log
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef BENCH_MD5_H
+#define BENCH_MD5_H
+
+/* not MD5: the module only needs a stable digest of MD5_DIGEST_SIZE bytes */
+typedef unsigned char md5_byte_t;
+
+typedef struct
+{
+    zbx_uint64_t h;
+}
+md5_state_t;
+
+#define MD5_DIGEST_SIZE         16
+
+void zbx_md5_init(md5_state_t *pms);
+void zbx_md5_append(md5_state_t *pms, const md5_byte_t *data, int nbytes);
+void zbx_md5_finish(md5_state_t *pms, md5_byte_t digest[16]);
+
+#endif
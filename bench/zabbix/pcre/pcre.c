@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+#include "pcre.h"
+
+/*
+PCRE over POSIX extended regular expressions. The classes \d, \w and \s are translated, which
+covers the patterns GlassFish items use; there is no study or JIT, pcre_study() only returns
+the extra block the module frees again.
+*/
+struct real_pcre
+{
+    regex_t re;
+};
+
+/*
+*/
+static void pcre_translate(const char *pattern, char *out, size_t size)
+{
+    const char *with;
+    size_t n = 0, length;
+
+    for (; *pattern != '\0'; pattern++)
+    {
+        with = NULL;
+
+        if (pattern[0] == '\\' && pattern[1] == 'd')
+            with = "[0-9]";
+        else if (pattern[0] == '\\' && pattern[1] == 'w')
+            with = "[A-Za-z0-9_]";
+        else if (pattern[0] == '\\' && pattern[1] == 's')
+            with = "[[:space:]]";
+
+        length = (with != NULL ? strlen(with) : 1);
+
+        if (n + length + 1 > size)
+            break;
+
+        if (with != NULL)
+        {
+            memcpy(out + n, with, length);
+            pattern++;
+        }
+        else
+            out[n] = *pattern;
+
+        n += length;
+    }
+
+    out[n] = '\0';
+}
+
+/*
+*/
+pcre *pcre_compile(const char *pattern, int options, const char **errptr, int *erroffset,
+                   const unsigned char *tableptr)
+{
+    char translated[4096];
+    pcre *code;
+
+    (void)tableptr;
+
+    if ((code = (pcre *)malloc(sizeof(*code))) == NULL)
+        return NULL;
+
+    pcre_translate(pattern, translated, sizeof(translated));
+
+    if (regcomp(&code->re, translated, REG_EXTENDED | ((options & PCRE_MULTILINE) != 0 ? REG_NEWLINE : 0)) != 0)
+    {
+        free(code);
+        *errptr = "invalid regular expression";
+        *erroffset = 0;
+        return NULL;
+    }
+
+    return code;
+}
+
+/*
+*/
+pcre_extra *pcre_study(const pcre *code, int options, const char **errptr)
+{
+    (void)code;
+    (void)options;
+
+    *errptr = NULL;
+
+    return (pcre_extra *)calloc(1, sizeof(pcre_extra));
+}
+
+/*
+*/
+void pcre_free_study(pcre_extra *extra)
+{
+    free(extra);
+}
+
+/*
+*/
+int pcre_exec(const pcre *code, const pcre_extra *extra, const char *subject, int length, int startoffset,
+              int options, int *ovector, int ovecsize)
+{
+    regmatch_t match[10];
+    int i, count = ovecsize / 3;
+
+    (void)extra;
+    (void)length;
+    (void)startoffset;
+    (void)options;
+
+    if (count > 10)
+        count = 10;
+
+    if (regexec(&code->re, subject, (size_t)count, match, 0) != 0)
+        return PCRE_ERROR_NOMATCH;
+
+    for (i = 0; i < count; i++)
+    {
+        ovector[2 * i] = (int)match[i].rm_so;
+        ovector[2 * i + 1] = (int)match[i].rm_eo;
+    }
+
+    for (i = count - 1; i > 0 && match[i].rm_so == -1; i--)
+        ;
+
+    return i + 1;
+}
+
+/*
+*/
+int pcre_get_substring(const char *subject, int *ovector, int stringcount, int stringnumber,
+                       const char **stringptr)
+{
+    int length;
+    char *copy;
+
+    if (stringnumber < 0 || stringnumber >= stringcount)
+        return PCRE_ERROR_NOSUBSTRING;
+
+    length = ovector[2 * stringnumber + 1] - ovector[2 * stringnumber];
+
+    if ((copy = (char *)malloc((size_t)length + 1)) == NULL)
+        return PCRE_ERROR_NOSUBSTRING;
+
+    memcpy(copy, subject + ovector[2 * stringnumber], (size_t)length);
+    copy[length] = '\0';
+    *stringptr = copy;
+
+    return length;
+}
+
+/*
+*/
+void pcre_free_substring(const char *stringptr)
+{
+    free((void *)stringptr);
+}
+
+/*
+*/
+static void pcre_code_free(void *ptr)
+{
+    pcre *code = (pcre *)ptr;
+
+    regfree(&code->re);
+    free(code);
+}
+
+void (*pcre_free)(void *) = pcre_code_free;
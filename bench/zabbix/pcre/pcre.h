@@ -0,0 +1,33 @@
+/*
+The subset of the PCRE 8 API the module uses, implemented by pcre.c over POSIX regular
+expressions for hosts without libpcre. Build with PCRE=1 to use the real library instead.
+*/
+#ifndef BENCH_PCRE_H
+#define BENCH_PCRE_H
+
+typedef struct real_pcre pcre;
+
+typedef struct pcre_extra
+{
+    unsigned long flags;
+}
+pcre_extra;
+
+#define PCRE_MULTILINE          0x00000002
+#define PCRE_STUDY_JIT_COMPILE  0x0001
+#define PCRE_ERROR_NOMATCH      (-1)
+#define PCRE_ERROR_NOSUBSTRING  (-7)
+
+pcre *pcre_compile(const char *pattern, int options, const char **errptr, int *erroffset,
+                   const unsigned char *tableptr);
+pcre_extra *pcre_study(const pcre *code, int options, const char **errptr);
+void pcre_free_study(pcre_extra *extra);
+int pcre_exec(const pcre *code, const pcre_extra *extra, const char *subject, int length, int startoffset,
+              int options, int *ovector, int ovecsize);
+int pcre_get_substring(const char *subject, int *ovector, int stringcount, int stringnumber,
+                       const char **stringptr);
+void pcre_free_substring(const char *stringptr);
+
+extern void (*pcre_free)(void *);
+
+#endif
@@ -0,0 +1,691 @@
+#define _GNU_SOURCE
+#include "sysinc.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include "zbxjson.h"
+#include "md5.h"
+#include <stddef.h>
+
+/*
+Stand-ins for the Zabbix functions the module calls, enough to run its item handlers outside
+the agent. Allocation failures abort, as they do in the agent.
+*/
+int benchLogLevel = LOG_LEVEL_WARNING;
+
+/* added to zbx_time(), the benchmarks move the clock of the module to expire its caches */
+double benchClockSkew;
+
+/*
+*/
+void __zbx_zabbix_log(int level, const char *fmt, ...)
+{
+    va_list args;
+
+    if (level == LOG_LEVEL_INFORMATION ? benchLogLevel < LOG_LEVEL_DEBUG : level > benchLogLevel)
+        return;
+
+    va_start(args, fmt);
+    fprintf(stderr, "[%d] ", level);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+/*
+*/
+static void *bench_checked(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        abort();
+    }
+
+    return ptr;
+}
+
+/*
+*/
+void *zbx_malloc2(const char *filename, int line, void *old, size_t size)
+{
+    ZBX_UNUSED(filename);
+    ZBX_UNUSED(line);
+    ZBX_UNUSED(old);
+
+    return bench_checked(malloc(size != 0 ? size : 1));
+}
+
+/*
+*/
+void *zbx_calloc2(const char *filename, int line, void *old, size_t nmemb, size_t size)
+{
+    ZBX_UNUSED(filename);
+    ZBX_UNUSED(line);
+    ZBX_UNUSED(old);
+
+    return bench_checked(calloc(nmemb != 0 ? nmemb : 1, size != 0 ? size : 1));
+}
+
+/*
+*/
+void *zbx_realloc2(const char *filename, int line, void *old, size_t size)
+{
+    ZBX_UNUSED(filename);
+    ZBX_UNUSED(line);
+
+    return bench_checked(realloc(old, size != 0 ? size : 1));
+}
+
+/*
+*/
+char *zbx_strdup2(const char *filename, int line, char *old, const char *str)
+{
+    ZBX_UNUSED(filename);
+    ZBX_UNUSED(line);
+
+    free(old);
+
+    return bench_checked(strdup(str));
+}
+
+/*
+*/
+size_t zbx_snprintf(char *str, size_t count, const char *fmt, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = vsnprintf(str, count, fmt, args);
+    va_end(args);
+
+    if (n < 0)
+        return 0;
+
+    if ((size_t)n >= count)
+        return (count != 0 ? count - 1 : 0);
+
+    return (size_t)n;
+}
+
+/*
+*/
+char *zbx_dsprintf(char *dest, const char *f, ...)
+{
+    va_list args;
+    char *str;
+
+    va_start(args, f);
+
+    if (vasprintf(&str, f, args) < 0)
+        str = NULL;
+
+    va_end(args);
+    free(dest);
+
+    return bench_checked(str);
+}
+
+/*
+*/
+static void bench_reserve(char **str, size_t *alloc_len, size_t offset, size_t n)
+{
+    if (*str == NULL || offset + n + 1 > *alloc_len)
+    {
+        *alloc_len = (offset + n + 1) * 2;
+        *str = (char *)bench_checked(realloc(*str, *alloc_len));
+    }
+}
+
+/*
+*/
+void zbx_snprintf_alloc(char **str, size_t *alloc_len, size_t *offset, const char *fmt, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    bench_reserve(str, alloc_len, *offset, (size_t)n);
+
+    va_start(args, fmt);
+    vsnprintf(*str + *offset, (size_t)n + 1, fmt, args);
+    va_end(args);
+
+    *offset += (size_t)n;
+}
+
+/*
+*/
+void zbx_strncpy_alloc(char **str, size_t *alloc_len, size_t *offset, const char *src, size_t n)
+{
+    bench_reserve(str, alloc_len, *offset, n);
+    memcpy(*str + *offset, src, n);
+    *offset += n;
+    (*str)[*offset] = '\0';
+}
+
+/*
+*/
+void zbx_strcpy_alloc(char **str, size_t *alloc_len, size_t *offset, const char *src)
+{
+    zbx_strncpy_alloc(str, alloc_len, offset, src, strlen(src));
+}
+
+/*
+*/
+void zbx_chrcpy_alloc(char **str, size_t *alloc_len, size_t *offset, char c)
+{
+    zbx_strncpy_alloc(str, alloc_len, offset, &c, 1);
+}
+
+/*
+*/
+size_t zbx_strlcpy(char *dst, const char *src, size_t siz)
+{
+    size_t n = strlen(src);
+
+    if (siz == 0)
+        return 0;
+
+    if (n >= siz)
+        n = siz - 1;
+
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+
+    return n;
+}
+
+/*
+*/
+void zbx_rtrim(char *str, const char *charlist)
+{
+    size_t n = strlen(str);
+
+    while (n > 0 && strchr(charlist, str[n - 1]) != NULL)
+        str[--n] = '\0';
+}
+
+/*
+*/
+void zbx_ltrim(char *str, const char *charlist)
+{
+    char *p = str;
+
+    while (*p != '\0' && strchr(charlist, *p) != NULL)
+        p++;
+
+    memmove(str, p, strlen(p) + 1);
+}
+
+/*
+*/
+void zbx_lrtrim(char *str, const char *charlist)
+{
+    zbx_rtrim(str, charlist);
+    zbx_ltrim(str, charlist);
+}
+
+/*
+*/
+int is_uint64(const char *str, zbx_uint64_t *value)
+{
+    unsigned long long number;
+    char *end;
+
+    if (!isdigit((unsigned char)*str))
+        return FAIL;
+
+    errno = 0;
+    number = strtoull(str, &end, 10);
+
+    if (*end != '\0' || errno != 0)
+        return FAIL;
+
+    if (value != NULL)
+        *value = (zbx_uint64_t)number;
+
+    return SUCCEED;
+}
+
+/*
+*/
+const char *zbx_strerror(int errnum)
+{
+    return strerror(errnum);
+}
+
+/*
+*/
+double zbx_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9 + benchClockSkew;
+}
+
+/*
+Appends text to the document and repeats the closing brackets of the open levels after it,
+so that buffer is valid JSON at any time, as with the agent.
+*/
+static void bench_json_put(struct zbx_json *j, const char *text)
+{
+    size_t n = strlen(text), need;
+    int level;
+    char *buffer;
+
+    need = j->buffer_offset + n + (size_t)j->level + 1;
+
+    if (need > j->buffer_allocated)
+    {
+        buffer = (char *)bench_checked(malloc(need * 2));
+        memcpy(buffer, j->buffer, j->buffer_offset);
+
+        if (j->buffer != j->buf_stat)
+            free(j->buffer);
+
+        j->buffer = buffer;
+        j->buffer_allocated = need * 2;
+    }
+
+    memcpy(j->buffer + j->buffer_offset, text, n);
+    j->buffer_offset += n;
+    j->buffer_size = j->buffer_offset;
+
+    for (level = j->level; level > 0; level--)
+        j->buffer[j->buffer_size++] = j->closing[level];
+
+    j->buffer[j->buffer_size] = '\0';
+}
+
+/*
+*/
+static void bench_json_open(struct zbx_json *j, const char *opening, char closing)
+{
+    bench_json_put(j, opening);
+    j->closing[++j->level] = closing;
+    j->status = ZBX_JSON_EMPTY;
+    bench_json_put(j, "");
+}
+
+/*
+*/
+static void bench_json_name(struct zbx_json *j, const char *name)
+{
+    if (j->status == ZBX_JSON_COMMA)
+        bench_json_put(j, ",");
+
+    if (name != NULL)
+    {
+        bench_json_put(j, "\"");
+        bench_json_put(j, name);
+        bench_json_put(j, "\":");
+    }
+}
+
+/*
+*/
+void zbx_json_init(struct zbx_json *j, size_t allocate)
+{
+    ZBX_UNUSED(allocate);
+
+    memset(j, 0, sizeof(*j));
+    j->buffer = j->buf_stat;
+    j->buffer_allocated = sizeof(j->buf_stat);
+    bench_json_open(j, "{", '}');
+}
+
+/*
+*/
+void zbx_json_initarray(struct zbx_json *j, size_t allocate)
+{
+    ZBX_UNUSED(allocate);
+
+    memset(j, 0, sizeof(*j));
+    j->buffer = j->buf_stat;
+    j->buffer_allocated = sizeof(j->buf_stat);
+    bench_json_open(j, "[", ']');
+}
+
+/*
+*/
+void zbx_json_free(struct zbx_json *j)
+{
+    if (j->buffer != j->buf_stat)
+        free(j->buffer);
+
+    j->buffer = NULL;
+}
+
+/*
+*/
+void zbx_json_addobject(struct zbx_json *j, const char *name)
+{
+    bench_json_name(j, name);
+    bench_json_open(j, "{", '}');
+}
+
+/*
+*/
+void zbx_json_addarray(struct zbx_json *j, const char *name)
+{
+    bench_json_name(j, name);
+    bench_json_open(j, "[", ']');
+}
+
+/*
+Strings are written as they are, the module escapes nothing the agent would.
+*/
+void zbx_json_addstring(struct zbx_json *j, const char *name, const char *string, int type)
+{
+    bench_json_name(j, name);
+
+    if (string == NULL)
+        bench_json_put(j, "null");
+    else if (type == ZBX_JSON_TYPE_STRING)
+    {
+        bench_json_put(j, "\"");
+        bench_json_put(j, string);
+        bench_json_put(j, "\"");
+    }
+    else
+        bench_json_put(j, string);
+
+    j->status = ZBX_JSON_COMMA;
+}
+
+/*
+*/
+void zbx_json_adduint64(struct zbx_json *j, const char *name, zbx_uint64_t value)
+{
+    char buffer[32];
+
+    zbx_snprintf(buffer, sizeof(buffer), ZBX_FS_UI64, value);
+    zbx_json_addstring(j, name, buffer, ZBX_JSON_TYPE_INT);
+}
+
+/*
+*/
+void zbx_json_addfloat(struct zbx_json *j, const char *name, double value)
+{
+    char buffer[64];
+
+    zbx_snprintf(buffer, sizeof(buffer), "%.6f", value);
+    zbx_json_addstring(j, name, buffer, ZBX_JSON_TYPE_INT);
+}
+
+/*
+*/
+int zbx_json_close(struct zbx_json *j)
+{
+    char closing[2];
+
+    if (j->level <= 1)
+        return FAIL;
+
+    closing[0] = j->closing[j->level--];
+    closing[1] = '\0';
+    bench_json_put(j, closing);
+    j->status = ZBX_JSON_COMMA;
+
+    return SUCCEED;
+}
+
+/*
+*/
+zbx_hash_t zbx_hash_modfnv(const void *data, size_t len, zbx_hash_t seed)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    zbx_uint64_t hash = 14695981039346656037ULL ^ seed;
+
+    while (len-- > 0)
+        hash = (hash ^ *p++) * 1099511628211ULL;
+
+    return hash;
+}
+
+/*
+*/
+zbx_hash_t zbx_default_string_hash_func(const void *data)
+{
+    return zbx_hash_modfnv(data, strlen((const char *)data), ZBX_DEFAULT_HASH_SEED);
+}
+
+/*
+*/
+int zbx_default_str_compare_func(const void *d1, const void *d2)
+{
+    return strcmp(*(const char * const *)d1, *(const char * const *)d2);
+}
+
+/*
+*/
+void *zbx_default_mem_malloc_func(void *old, size_t size)
+{
+    ZBX_UNUSED(old);
+
+    return malloc(size);
+}
+
+/*
+*/
+void *zbx_default_mem_realloc_func(void *old, size_t size)
+{
+    return realloc(old, size);
+}
+
+/*
+*/
+void zbx_default_mem_free_func(void *ptr)
+{
+    free(ptr);
+}
+
+/*
+Chained hashset with a fixed number of slots, enough for the entry counts of the benchmarks.
+*/
+void zbx_hashset_create_ext(zbx_hashset_t *hs, size_t init_size, zbx_hash_func_t hash_func,
+                            zbx_compare_func_t compare_func, zbx_clean_func_t clean_func,
+                            zbx_mem_malloc_func_t mem_malloc_func, zbx_mem_realloc_func_t mem_realloc_func,
+                            zbx_mem_free_func_t mem_free_func)
+{
+    memset(hs, 0, sizeof(*hs));
+    hs->num_slots = (init_size < 64 ? 64 : (int)init_size);
+    hs->slots = (ZBX_HASHSET_ENTRY_T **)bench_checked(calloc((size_t)hs->num_slots, sizeof(*hs->slots)));
+    hs->hash_func = hash_func;
+    hs->compare_func = compare_func;
+    hs->clean_func = clean_func;
+    hs->mem_malloc_func = mem_malloc_func;
+    hs->mem_realloc_func = mem_realloc_func;
+    hs->mem_free_func = mem_free_func;
+}
+
+/*
+*/
+void zbx_hashset_clear(zbx_hashset_t *hs)
+{
+    ZBX_HASHSET_ENTRY_T *entry, *next;
+    int i;
+
+    for (i = 0; i < hs->num_slots; i++)
+    {
+        for (entry = hs->slots[i]; entry != NULL; entry = next)
+        {
+            next = entry->next;
+
+            if (hs->clean_func != NULL)
+                hs->clean_func(entry->data);
+
+            hs->mem_free_func(entry);
+        }
+
+        hs->slots[i] = NULL;
+    }
+
+    hs->num_data = 0;
+}
+
+/*
+*/
+void zbx_hashset_destroy(zbx_hashset_t *hs)
+{
+    if (hs->slots == NULL)
+        return;
+
+    zbx_hashset_clear(hs);
+    free(hs->slots);
+    hs->slots = NULL;
+}
+
+/*
+*/
+void *zbx_hashset_search(zbx_hashset_t *hs, const void *data)
+{
+    ZBX_HASHSET_ENTRY_T *entry;
+    zbx_hash_t hash = hs->hash_func(data);
+
+    for (entry = hs->slots[hash % (zbx_hash_t)hs->num_slots]; entry != NULL; entry = entry->next)
+    {
+        if (entry->hash == hash && hs->compare_func(entry->data, data) == 0)
+            return entry->data;
+    }
+
+    return NULL;
+}
+
+/*
+*/
+void *zbx_hashset_insert(zbx_hashset_t *hs, const void *data, size_t size)
+{
+    ZBX_HASHSET_ENTRY_T *entry;
+    void *found;
+    int slot;
+
+    if ((found = zbx_hashset_search(hs, data)) != NULL)
+        return found;
+
+    entry = (ZBX_HASHSET_ENTRY_T *)bench_checked(hs->mem_malloc_func(NULL, offsetof(ZBX_HASHSET_ENTRY_T, data) + size));
+    entry->hash = hs->hash_func(data);
+    memcpy(entry->data, data, size);
+
+    slot = (int)(entry->hash % (zbx_hash_t)hs->num_slots);
+    entry->next = hs->slots[slot];
+    hs->slots[slot] = entry;
+    hs->num_data++;
+
+    return entry->data;
+}
+
+/*
+*/
+void zbx_hashset_remove_direct(zbx_hashset_t *hs, const void *data)
+{
+    ZBX_HASHSET_ENTRY_T *entry, **link;
+
+    entry = (ZBX_HASHSET_ENTRY_T *)((const char *)data - offsetof(ZBX_HASHSET_ENTRY_T, data));
+
+    for (link = &hs->slots[entry->hash % (zbx_hash_t)hs->num_slots]; *link != NULL; link = &(*link)->next)
+    {
+        if (*link != entry)
+            continue;
+
+        *link = entry->next;
+
+        if (hs->clean_func != NULL)
+            hs->clean_func(entry->data);
+
+        hs->mem_free_func(entry);
+        hs->num_data--;
+        return;
+    }
+}
+
+/*
+*/
+void zbx_hashset_iter_reset(zbx_hashset_t *hs, zbx_hashset_iter_t *iter)
+{
+    iter->hashset = hs;
+    iter->slot = -1;
+    iter->entry = NULL;
+    iter->prev = NULL;
+}
+
+/*
+*/
+void *zbx_hashset_iter_next(zbx_hashset_iter_t *iter)
+{
+    if (iter->entry != NULL)
+    {
+        iter->prev = iter->entry;
+        iter->entry = iter->entry->next;
+    }
+    else if (iter->slot >= 0 && iter->prev != NULL)
+    {
+        /* the entry was removed, continue after the one before it */
+        iter->entry = iter->prev->next;
+    }
+    else if (iter->slot >= 0)
+        iter->entry = iter->hashset->slots[iter->slot];
+
+    while (iter->entry == NULL)
+    {
+        if (++iter->slot >= iter->hashset->num_slots)
+            return NULL;
+
+        iter->prev = NULL;
+        iter->entry = iter->hashset->slots[iter->slot];
+    }
+
+    return iter->entry->data;
+}
+
+/*
+*/
+void zbx_hashset_iter_remove(zbx_hashset_iter_t *iter)
+{
+    zbx_hashset_t *hs = iter->hashset;
+    ZBX_HASHSET_ENTRY_T *entry = iter->entry;
+
+    if (iter->prev != NULL)
+        iter->prev->next = entry->next;
+    else
+        hs->slots[iter->slot] = entry->next;
+
+    if (hs->clean_func != NULL)
+        hs->clean_func(entry->data);
+
+    hs->mem_free_func(entry);
+    hs->num_data--;
+    iter->entry = NULL;
+}
+
+/*
+*/
+void zbx_md5_init(md5_state_t *pms)
+{
+    pms->h = 14695981039346656037ULL;
+}
+
+/*
+*/
+void zbx_md5_append(md5_state_t *pms, const md5_byte_t *data, int nbytes)
+{
+    pms->h = zbx_hash_modfnv(data, (size_t)nbytes, pms->h);
+}
+
+/*
+*/
+void zbx_md5_finish(md5_state_t *pms, md5_byte_t digest[16])
+{
+    zbx_uint64_t halves[2];
+
+    halves[0] = pms->h;
+    halves[1] = zbx_hash_modfnv(&pms->h, sizeof(pms->h), 0x5bd1e995);
+    memcpy(digest, halves, 16);
+}
@@ -0,0 +1,22 @@
+/*
+Stand-ins for the Zabbix headers the module is built against, just enough to link it into
+the benchmarks without a Zabbix source tree. Nothing here is used by the agent itself.
+*/
+#ifndef BENCH_SYSINC_H
+#define BENCH_SYSINC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#endif
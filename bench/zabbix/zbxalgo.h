@@ -0,0 +1,75 @@
+#ifndef BENCH_ZBXALGO_H
+#define BENCH_ZBXALGO_H
+
+#include "common.h"
+
+typedef zbx_uint64_t zbx_hash_t;
+
+typedef zbx_hash_t (*zbx_hash_func_t)(const void *data);
+typedef int (*zbx_compare_func_t)(const void *d1, const void *d2);
+typedef void *(*zbx_mem_malloc_func_t)(void *old, size_t size);
+typedef void *(*zbx_mem_realloc_func_t)(void *old, size_t size);
+typedef void (*zbx_mem_free_func_t)(void *ptr);
+typedef void (*zbx_clean_func_t)(void *data);
+
+#define ZBX_DEFAULT_HASH_SEED           0
+#define ZBX_DEFAULT_HASH_ALGO           zbx_hash_modfnv
+#define ZBX_DEFAULT_STRING_HASH_ALGO    zbx_hash_modfnv
+#define ZBX_DEFAULT_STRING_HASH_FUNC    zbx_default_string_hash_func
+#define ZBX_DEFAULT_STRING_COMPARE_FUNC zbx_default_str_compare_func
+#define ZBX_DEFAULT_MEM_MALLOC_FUNC     zbx_default_mem_malloc_func
+#define ZBX_DEFAULT_MEM_REALLOC_FUNC    zbx_default_mem_realloc_func
+#define ZBX_DEFAULT_MEM_FREE_FUNC       zbx_default_mem_free_func
+
+zbx_hash_t zbx_hash_modfnv(const void *data, size_t len, zbx_hash_t seed);
+zbx_hash_t zbx_default_string_hash_func(const void *data);
+int zbx_default_str_compare_func(const void *d1, const void *d2);
+void *zbx_default_mem_malloc_func(void *old, size_t size);
+void *zbx_default_mem_realloc_func(void *old, size_t size);
+void zbx_default_mem_free_func(void *ptr);
+
+typedef struct zbx_hashset_entry_s
+{
+    struct zbx_hashset_entry_s *next;
+    zbx_hash_t hash;
+    char data[1];
+}
+ZBX_HASHSET_ENTRY_T;
+
+typedef struct
+{
+    ZBX_HASHSET_ENTRY_T **slots;
+    int num_slots;
+    int num_data;
+    zbx_hash_func_t hash_func;
+    zbx_compare_func_t compare_func;
+    zbx_clean_func_t clean_func;
+    zbx_mem_malloc_func_t mem_malloc_func;
+    zbx_mem_realloc_func_t mem_realloc_func;
+    zbx_mem_free_func_t mem_free_func;
+}
+zbx_hashset_t;
+
+typedef struct
+{
+    zbx_hashset_t *hashset;
+    int slot;
+    ZBX_HASHSET_ENTRY_T *entry;
+    ZBX_HASHSET_ENTRY_T *prev;
+}
+zbx_hashset_iter_t;
+
+void zbx_hashset_create_ext(zbx_hashset_t *hs, size_t init_size, zbx_hash_func_t hash_func,
+                            zbx_compare_func_t compare_func, zbx_clean_func_t clean_func,
+                            zbx_mem_malloc_func_t mem_malloc_func, zbx_mem_realloc_func_t mem_realloc_func,
+                            zbx_mem_free_func_t mem_free_func);
+void zbx_hashset_destroy(zbx_hashset_t *hs);
+void zbx_hashset_clear(zbx_hashset_t *hs);
+void *zbx_hashset_insert(zbx_hashset_t *hs, const void *data, size_t size);
+void *zbx_hashset_search(zbx_hashset_t *hs, const void *data);
+void zbx_hashset_remove_direct(zbx_hashset_t *hs, const void *data);
+void zbx_hashset_iter_reset(zbx_hashset_t *hs, zbx_hashset_iter_t *iter);
+void *zbx_hashset_iter_next(zbx_hashset_iter_t *iter);
+void zbx_hashset_iter_remove(zbx_hashset_iter_t *iter);
+
+#endif
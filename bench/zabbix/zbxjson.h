@@ -0,0 +1,38 @@
+#ifndef BENCH_ZBXJSON_H
+#define BENCH_ZBXJSON_H
+
+#include "common.h"
+
+#define ZBX_JSON_STAT_BUF_LEN   4096
+#define ZBX_JSON_MAX_LEVEL      64
+
+typedef enum
+{
+    ZBX_JSON_EMPTY = 0,
+    ZBX_JSON_COMMA
+}
+zbx_json_status_t;
+
+struct zbx_json
+{
+    char *buffer;
+    char buf_stat[ZBX_JSON_STAT_BUF_LEN];
+    size_t buffer_allocated;
+    size_t buffer_offset;
+    size_t buffer_size;
+    zbx_json_status_t status;
+    int level;
+    char closing[ZBX_JSON_MAX_LEVEL];
+};
+
+void zbx_json_init(struct zbx_json *j, size_t allocate);
+void zbx_json_initarray(struct zbx_json *j, size_t allocate);
+void zbx_json_free(struct zbx_json *j);
+void zbx_json_addobject(struct zbx_json *j, const char *name);
+void zbx_json_addarray(struct zbx_json *j, const char *name);
+void zbx_json_addstring(struct zbx_json *j, const char *name, const char *string, int type);
+void zbx_json_adduint64(struct zbx_json *j, const char *name, zbx_uint64_t value);
+void zbx_json_addfloat(struct zbx_json *j, const char *name, double value);
+int zbx_json_close(struct zbx_json *j);
+
+#endif
@@ -0,0 +1,152 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include <curl/curl.h>
+#include <pthread.h>
+#include "glassfish.h"
+
+/* a GlassFish that failed its last request, keyed by scheme, host and port */
+struct breakerEntry
+{
+    char *endpoint;
+    int failures;
+    int backoff;
+    int probing;
+    double openUntil;
+};
+
+/* the collector thread reports its transfers too */
+static pthread_mutex_t breakerLock = PTHREAD_MUTEX_INITIALIZER;
+static zbx_hashset_t breakers;
+
+/*
+*/
+static void breaker_entry_clean(void *data)
+{
+    struct breakerEntry *entry = (struct breakerEntry *)data;
+
+    zbx_free(entry->endpoint);
+}
+
+/*
+*/
+void breaker_init(void)
+{
+    zbx_hashset_create_ext(&breakers, 16, STRING_PTR_HASH_FUNC, ZBX_DEFAULT_STRING_COMPARE_FUNC,
+                           breaker_entry_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+                           ZBX_DEFAULT_MEM_FREE_FUNC);
+}
+
+/*
+*/
+void breaker_destroy(void)
+{
+    zbx_hashset_destroy(&breakers);
+}
+
+/*
+Copies the scheme, host and port of fullURL, all requests to one GlassFish share a breaker.
+*/
+static void breaker_endpoint(const char *fullURL, char *endpoint)
+{
+    const char *host, *path;
+
+    host = ((host = strstr(fullURL, "://")) != NULL ? host + 3 : fullURL);
+
+    if ((path = strchr(host, '/')) == NULL)
+        path = host + strlen(host);
+
+    zbx_strlcpy(endpoint, fullURL, MIN((size_t)(path - fullURL) + 1, BREAKER_ENDPOINT_LENGTH));
+}
+
+/*
+Returns FAIL while the breaker of the endpoint is open. Once the backoff has passed one
+request is let through to probe the endpoint, the others keep failing until it is answered.
+*/
+int breaker_allow(const char *fullURL)
+{
+    struct breakerEntry *entry;
+    char endpoint[BREAKER_ENDPOINT_LENGTH], *key = endpoint;
+    double now;
+    int ret = SUCCEED;
+
+    breaker_endpoint(fullURL, endpoint);
+
+    pthread_mutex_lock(&breakerLock);
+
+    if (NULL != (entry = (struct breakerEntry *)zbx_hashset_search(&breakers, &key)) &&
+        entry->failures >= glassfishConfig.breakerFailures)
+    {
+        if ((now = zbx_time()) < entry->openUntil)
+        {
+            ret = FAIL;
+        }
+        else
+        {
+            entry->probing = 1;
+            entry->openUntil = now + entry->backoff;
+        }
+    }
+
+    pthread_mutex_unlock(&breakerLock);
+
+    return ret;
+}
+
+/*
+Counts a failed request of the endpoint, or forgets its failures after a request succeeded.
+The breaker opens at breaker_failures failures, only a failed probe doubles the backoff, not
+requests that were already running when it opened.
+*/
+void breaker_report(const char *fullURL, int succeeded)
+{
+    struct breakerEntry *entry, local;
+    char endpoint[BREAKER_ENDPOINT_LENGTH], *key = endpoint;
+
+    breaker_endpoint(fullURL, endpoint);
+
+    pthread_mutex_lock(&breakerLock);
+
+    entry = (struct breakerEntry *)zbx_hashset_search(&breakers, &key);
+
+    if (succeeded != 0)
+    {
+        if (entry != NULL)
+        {
+            if (entry->failures >= glassfishConfig.breakerFailures)
+            {
+                zabbix_log(LOG_LEVEL_INFORMATION, "Module: %s - %s is answering again (%s:%d)",
+                           MODULE_NAME, endpoint, __FILE__, __LINE__ );
+            }
+
+            zbx_hashset_remove_direct(&breakers, entry);
+        }
+    }
+    else
+    {
+        if (entry == NULL)
+        {
+            memset(&local, 0, sizeof(local));
+            local.endpoint = zbx_strdup(NULL, endpoint);
+            entry = (struct breakerEntry *)zbx_hashset_insert(&breakers, &local, sizeof(local));
+        }
+
+        if (++entry->failures == glassfishConfig.breakerFailures || entry->probing != 0)
+        {
+            if (entry->probing != 0)
+                entry->backoff = MIN(entry->backoff * 2, glassfishConfig.breakerMaxBackoff);
+            else
+                entry->backoff = glassfishConfig.breakerBackoff;
+
+            entry->probing = 0;
+            entry->openUntil = zbx_time() + entry->backoff;
+
+            zabbix_log(LOG_LEVEL_WARNING, "Module: %s - %s failed %d times, not asking it for %d seconds (%s:%d)",
+                       MODULE_NAME, endpoint, entry->failures, entry->backoff, __FILE__, __LINE__ );
+        }
+    }
+
+    pthread_mutex_unlock(&breakerLock);
+}
@@ -0,0 +1,871 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include "md5.h"
+#include <curl/curl.h>
+#include "glassfish.h"
+
+/*
+A response body with what is needed to tell whether it changed: the validators of the
+response for a conditional request, and a digest of the body for servers that send none.
+ttl grows while the body stays the same and drops back to the cache ttl of its profile when it changes.
+stale is when a body restored from the snapshot was fetched, 0 once it has been refreshed.
+*/
+struct cacheEntry
+{
+    char *key;
+    char *data;
+    double created;
+    double ttl;
+    double stale;
+    zbx_uint64_t version;
+    struct fetchValidators validators;
+    md5_byte_t digest[MD5_DIGEST_SIZE];
+};
+
+/* value parsed out of a body, valid as long as the body has the same version */
+struct cacheValue
+{
+    char *key;
+    char *value;
+    zbx_uint64_t version;
+    double used;
+};
+
+struct bulkValue
+{
+    char *key;
+    char *value;
+};
+
+struct bulkIndex
+{
+    char *key;
+    double created;
+    double stale;
+    zbx_hashset_t values;
+    zbx_hashset_t rollups;
+};
+
+static zbx_hashset_t cache;
+static zbx_hashset_t values;
+static zbx_hashset_t indexes;
+static struct cacheStats stats;
+static zbx_uint64_t versionClock;
+
+/*
+*/
+static void cache_entry_clean(void *data)
+{
+    struct cacheEntry *entry = (struct cacheEntry *)data;
+
+    zbx_free(entry->key);
+    zbx_free(entry->data);
+    zbx_free(entry->validators.etag);
+    zbx_free(entry->validators.lastModified);
+}
+
+/*
+*/
+static void cache_value_clean(void *data)
+{
+    struct cacheValue *value = (struct cacheValue *)data;
+
+    zbx_free(value->key);
+    zbx_free(value->value);
+}
+
+/*
+*/
+static void bulk_value_clean(void *data)
+{
+    struct bulkValue *value = (struct bulkValue *)data;
+
+    zbx_free(value->key);
+    zbx_free(value->value);
+}
+
+/*
+*/
+static void rollup_application_clean(void *data)
+{
+    struct rollupApplication *application = (struct rollupApplication *)data;
+
+    zbx_free(application->name);
+}
+
+/*
+*/
+static void bulk_rollup_clean(void *data)
+{
+    struct bulkRollup *rollup = (struct bulkRollup *)data;
+
+    zbx_free(rollup->key);
+    zbx_free(rollup->suffix);
+    zbx_hashset_destroy(&rollup->applications);
+}
+
+/*
+*/
+static void bulk_index_clean(void *data)
+{
+    struct bulkIndex *index = (struct bulkIndex *)data;
+
+    zbx_free(index->key);
+    zbx_hashset_destroy(&index->values);
+    zbx_hashset_destroy(&index->rollups);
+}
+
+/*
+Hashes the string a hashset entry starts with. ZBX_DEFAULT_STRING_HASH_FUNC hashes the entry
+itself as a string, so entries with a char * key would never be found again.
+*/
+zbx_hash_t string_ptr_hash_func(const void *data)
+{
+    const char *str = *(const char * const *)data;
+
+    return ZBX_DEFAULT_STRING_HASH_ALGO(str, strlen(str), ZBX_DEFAULT_HASH_SEED);
+}
+
+/*
+*/
+void cache_init(void)
+{
+    zbx_hashset_create_ext(&cache, CACHE_MAX_ENTRIES, STRING_PTR_HASH_FUNC, ZBX_DEFAULT_STRING_COMPARE_FUNC,
+                           cache_entry_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+                           ZBX_DEFAULT_MEM_FREE_FUNC);
+    zbx_hashset_create_ext(&values, CACHE_MAX_ENTRIES, STRING_PTR_HASH_FUNC, ZBX_DEFAULT_STRING_COMPARE_FUNC,
+                           cache_value_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+                           ZBX_DEFAULT_MEM_FREE_FUNC);
+    zbx_hashset_create_ext(&indexes, 16, STRING_PTR_HASH_FUNC, ZBX_DEFAULT_STRING_COMPARE_FUNC,
+                           bulk_index_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+                           ZBX_DEFAULT_MEM_FREE_FUNC);
+    memset(&stats, 0, sizeof(stats));
+}
+
+/*
+*/
+void cache_destroy(void)
+{
+    zbx_hashset_destroy(&cache);
+    zbx_hashset_destroy(&values);
+    zbx_hashset_destroy(&indexes);
+}
+
+/*
+Builds the cache key: the URL with lower-case scheme and host, without repeated or trailing
+slashes, followed by a digest of the credentials so that passwords are not kept in the key.
+*/
+char *cache_key(const char *fullURL, const char *user, const char *password)
+{
+    char *key = NULL;
+    size_t keyAlloc = 0, keyOffset = 0;
+    const char *p, *path;
+    md5_state_t state;
+    md5_byte_t digest[MD5_DIGEST_SIZE];
+    int i;
+
+    if ((p = strstr(fullURL, "://")) != NULL)
+        p += 3;
+    else
+        p = fullURL;
+
+    path = p + strcspn(p, "/?");
+
+    for (p = fullURL; p < path; p++)
+        zbx_chrcpy_alloc(&key, &keyAlloc, &keyOffset, tolower((unsigned char)*p));
+
+    for (; *p != '\0' && *p != '?'; p++)
+    {
+        if (*p == '/' && (p[1] == '/' || p[1] == '\0' || p[1] == '?'))
+            continue;
+
+        zbx_chrcpy_alloc(&key, &keyAlloc, &keyOffset, *p);
+    }
+
+    if (*p == '?')
+        zbx_strcpy_alloc(&key, &keyAlloc, &keyOffset, p);
+
+    zbx_md5_init(&state);
+    zbx_md5_append(&state, (const md5_byte_t *)user, strlen(user));
+    zbx_md5_append(&state, (const md5_byte_t *)":", 1);
+    zbx_md5_append(&state, (const md5_byte_t *)password, strlen(password));
+    zbx_md5_finish(&state, digest);
+
+    zbx_chrcpy_alloc(&key, &keyAlloc, &keyOffset, ' ');
+
+    for (i = 0; i < MD5_DIGEST_SIZE; i++)
+        zbx_snprintf_alloc(&key, &keyAlloc, &keyOffset, "%02x", (unsigned int)digest[i]);
+
+    return key;
+}
+
+/*
+Returns a copy of the cached response body, or NULL if there is no fresh entry. *version,
+if given, identifies the body: it changes only when the body does.
+*/
+char *cache_get(const char *key, zbx_uint64_t *version)
+{
+    struct cacheEntry *entry;
+
+    if (NULL == (entry = (struct cacheEntry *)zbx_hashset_search(&cache, &key)) ||
+        entry->created + entry->ttl <= zbx_time())
+    {
+        stats.misses++;
+        return NULL;
+    }
+
+    if (version != NULL)
+        *version = entry->version;
+
+    if (entry->stale != 0)
+        stats.stale++;
+
+    stats.hits++;
+    return zbx_strdup(NULL, entry->data);
+}
+
+/*
+Versions of response bodies, shared by the response cache and the collector thread.
+*/
+zbx_uint64_t cache_version_next(void)
+{
+    return __atomic_add_fetch(&versionClock, 1, __ATOMIC_RELAXED);
+}
+
+/*
+Drops entries that were not refreshed for cache_max_ttl after they expired and, if the cache
+is still full, the oldest one. Expired entries are kept that long for their validators.
+*/
+static void cache_make_room(void)
+{
+    zbx_hashset_iter_t iter;
+    struct cacheEntry *entry, *oldest = NULL;
+    double now = zbx_time();
+
+    zbx_hashset_iter_reset(&cache, &iter);
+
+    while (NULL != (entry = (struct cacheEntry *)zbx_hashset_iter_next(&iter)))
+    {
+        if (entry->created + entry->ttl + glassfishConfig.cacheMaxTtl <= now)
+        {
+            zbx_hashset_iter_remove(&iter);
+            stats.evictions++;
+            continue;
+        }
+
+        if (oldest == NULL || entry->created < oldest->created)
+            oldest = entry;
+    }
+
+    if (cache.num_data >= CACHE_MAX_ENTRIES && oldest != NULL)
+    {
+        zbx_hashset_remove_direct(&cache, oldest);
+        stats.evictions++;
+    }
+}
+
+/*
+*/
+static void cache_digest(const char *data, md5_byte_t *digest)
+{
+    md5_state_t state;
+
+    zbx_md5_init(&state);
+    zbx_md5_append(&state, (const md5_byte_t *)data, strlen(data));
+    zbx_md5_finish(&state, digest);
+}
+
+/*
+Fetches the body for the request and caches it. An expired entry is revalidated with a conditional
+request; if GlassFish answers 304, or sends the same body again, the entry keeps its body and
+version and its ttl doubles up to cache_max_ttl. Both requests are single-flight across the
+agent processes, see fetch_shared(). Returns a copy of the body, or NULL if the request failed;
+a body restored from the snapshot is returned instead until it could be refreshed once.
+*/
+char *cache_refresh(struct fetchContext *ctx, const struct itemRequest *item, zbx_uint64_t *version)
+{
+    struct cacheEntry *entry, local;
+    md5_byte_t digest[MD5_DIGEST_SIZE];
+    char *data;
+    long status;
+
+    if (NULL == (entry = (struct cacheEntry *)zbx_hashset_search(&cache, &item->key)))
+    {
+        if ((data = fetch_shared(ctx, item->key, item->fullURL, item->user, item->password, item->profile)) == NULL)
+            return NULL;
+
+        if (cache.num_data >= CACHE_MAX_ENTRIES)
+            cache_make_room();
+
+        memset(&local, 0, sizeof(local));
+        local.key = zbx_strdup(NULL, item->key);
+        local.data = zbx_strdup(NULL, data);
+        local.created = zbx_time();
+        local.ttl = item->profile->cacheTtl;
+        local.version = cache_version_next();
+        cache_digest(data, local.digest);
+
+        if (version != NULL)
+            *version = local.version;
+
+        zbx_hashset_insert(&cache, &local, sizeof(local));
+
+        return data;
+    }
+
+    data = fetch_shared_conditional(ctx, item->key, item->fullURL, item->user, item->password, item->profile,
+                                    &entry->validators, entry->data, &status);
+
+    if (data == NULL && status != 304)
+    {
+        zbx_free(entry->validators.etag);
+        zbx_free(entry->validators.lastModified);
+
+        if (entry->stale == 0 || snapshot_usable(entry->stale) != SUCCEED)
+            return NULL;
+
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - serving the snapshot of %s (%s:%d)",
+                   MODULE_NAME, item->fullURL, __FILE__, __LINE__ );
+
+        if (version != NULL)
+            *version = entry->version;
+
+        stats.stale++;
+        return zbx_strdup(NULL, entry->data);
+    }
+
+    if (data != NULL)
+        cache_digest(data, digest);
+
+    if (data == NULL || memcmp(digest, entry->digest, sizeof(digest)) == 0)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - response did not change: %s (%s:%d)",
+                   MODULE_NAME, item->fullURL, __FILE__, __LINE__ );
+        zbx_free(data);
+        entry->ttl = MIN(entry->ttl * 2, glassfishConfig.cacheMaxTtl);
+        stats.unchanged++;
+    }
+    else
+    {
+        entry->data = zbx_strdup(entry->data, data);
+        entry->ttl = item->profile->cacheTtl;
+        entry->version = cache_version_next();
+        memcpy(entry->digest, digest, sizeof(digest));
+        zbx_free(data);
+    }
+
+    entry->created = zbx_time();
+    entry->stale = 0;
+
+    if (version != NULL)
+        *version = entry->version;
+
+    return zbx_strdup(NULL, entry->data);
+}
+
+/*
+Keys parsed values by the cache key of the body and the pattern that selected them.
+*/
+static char *cache_value_key(const char *key, const char *pattern)
+{
+    return zbx_dsprintf(NULL, "%s %s", key, pattern);
+}
+
+/*
+Looks up the value pattern selected in the body for key when the body had the given
+version. Returns SUCCEED with a copy of it in *value, NULL if the pattern did not match,
+or FAIL if the body has to be parsed.
+*/
+int cache_value_get(const char *key, const char *pattern, zbx_uint64_t version, char **value)
+{
+    struct cacheValue *found;
+    char *valueKey;
+
+    valueKey = cache_value_key(key, pattern);
+    found = (struct cacheValue *)zbx_hashset_search(&values, &valueKey);
+    zbx_free(valueKey);
+
+    if (found == NULL || found->version != version)
+        return FAIL;
+
+    found->used = zbx_time();
+    *value = (found->value != NULL ? zbx_strdup(NULL, found->value) : NULL);
+    stats.reused++;
+
+    return SUCCEED;
+}
+
+/*
+Remembers the value pattern selected in the body for key, value may be NULL. When all
+CACHE_MAX_ENTRIES values are taken the least recently used one is dropped.
+*/
+void cache_value_put(const char *key, const char *pattern, zbx_uint64_t version, const char *value)
+{
+    zbx_hashset_iter_t iter;
+    struct cacheValue *found, *oldest = NULL, local;
+
+    local.key = cache_value_key(key, pattern);
+
+    if (NULL == (found = (struct cacheValue *)zbx_hashset_search(&values, &local)))
+    {
+        if (values.num_data >= CACHE_MAX_ENTRIES)
+        {
+            zbx_hashset_iter_reset(&values, &iter);
+
+            while (NULL != (found = (struct cacheValue *)zbx_hashset_iter_next(&iter)))
+            {
+                if (oldest == NULL || found->used < oldest->used)
+                    oldest = found;
+            }
+
+            zbx_hashset_remove_direct(&values, oldest);
+        }
+
+        local.value = NULL;
+        found = (struct cacheValue *)zbx_hashset_insert(&values, &local, sizeof(local));
+    }
+    else
+        zbx_free(local.key);
+
+    zbx_free(found->value);
+
+    if (value != NULL)
+        found->value = zbx_strdup(NULL, value);
+
+    found->version = version;
+    found->used = zbx_time();
+}
+
+/*
+*/
+void cache_get_stats(struct cacheStats *out)
+{
+    *out = stats;
+    out->entries = cache.num_data;
+}
+
+/*
+Adds the value under an index key to the rollup if the key is "<application>/server.<statistic>"
+for ROLLUP_APPLICATION or "<application>/server/<servlet>.<statistic>" for ROLLUP_SERVLET.
+Names may contain dots, so the statistic is matched at the end of the key.
+*/
+static void bulk_rollup_add(struct bulkRollup *rollup, const char *key, const char *value)
+{
+    struct rollupApplication *application, local;
+    size_t keyLength = strlen(key), suffixLength = strlen(rollup->suffix);
+    const char *server;
+    char name[BULK_KEY_LENGTH];
+    double number;
+
+    if (keyLength <= suffixLength || strcmp(key + keyLength - suffixLength, rollup->suffix) != 0)
+        return;
+
+    if (NULL == (server = strstr(key, "/server")) || server == key)
+        return;
+
+    if (rollup->scope == ROLLUP_APPLICATION && server + 7 != key + keyLength - suffixLength)
+        return;
+
+    if (rollup->scope == ROLLUP_SERVLET && (server[7] != '/' || server + 8 >= key + keyLength - suffixLength ||
+        NULL != memchr(server + 8, '/', key + keyLength - suffixLength - server - 8)))
+    {
+        return;
+    }
+
+    number = atof(value);
+
+    if (rollup->count == 0 || number < rollup->min)
+        rollup->min = number;
+
+    if (rollup->count == 0 || number > rollup->max)
+        rollup->max = number;
+
+    rollup->sum += number;
+    rollup->count++;
+
+    zbx_strlcpy(name, key, MIN((size_t)(server - key) + 1, sizeof(name)));
+    local.name = name;
+
+    if (NULL != (application = (struct rollupApplication *)zbx_hashset_search(&rollup->applications, &local)))
+    {
+        application->value += number;
+        return;
+    }
+
+    local.name = zbx_strdup(NULL, name);
+    local.value = number;
+    zbx_hashset_insert(&rollup->applications, &local, sizeof(local));
+}
+
+/*
+*/
+static void bulk_rollup_add_all(struct bulkIndex *index, const char *key, const char *value)
+{
+    zbx_hashset_iter_t iter;
+    struct bulkRollup *rollup;
+
+    zbx_hashset_iter_reset(&index->rollups, &iter);
+
+    while (NULL != (rollup = (struct bulkRollup *)zbx_hashset_iter_next(&iter)))
+        bulk_rollup_add(rollup, key, value);
+}
+
+/*
+*/
+static void bulk_rollup_reset(struct bulkRollup *rollup)
+{
+    rollup->sum = 0;
+    rollup->min = 0;
+    rollup->max = 0;
+    rollup->count = 0;
+    zbx_hashset_clear(&rollup->applications);
+}
+
+/*
+Flattens a GlassFish monitoring response into "path.statistic.field" keys. The path is built
+from the names under "children", the statistic and the field from the levels under "entity",
+e.g. "DerbyPool.numconnused.current" for monitoring/domain/server/resources?depth=N.
+*/
+static int bulk_index_value(struct jsonScanner *js, const char *value, int isString, void *ctx)
+{
+    struct bulkIndex *index = (struct bulkIndex *)ctx;
+    struct bulkValue local, *found;
+    char key[BULK_KEY_LENGTH];
+    size_t offset = 0;
+    int i, entity = -1;
+
+    for (i = 0; i < js->depth; i++)
+    {
+        if (strcmp(js->keys[i], "entity") == 0)
+        {
+            entity = i;
+            break;
+        }
+
+        if (strcmp(js->keys[i], "children") == 0 && i + 1 < js->depth)
+        {
+            offset += zbx_snprintf(key + offset, sizeof(key) - offset, "%s%s", (offset == 0 ? "" : "/"),
+                                   js->keys[++i]);
+        }
+    }
+
+    if (entity < 0 || js->depth - entity - 1 < 1 || js->depth - entity - 1 > 2)
+        return 0;
+
+    for (i = entity + 1; i < js->depth; i++)
+        offset += zbx_snprintf(key + offset, sizeof(key) - offset, "%s%s", (offset == 0 ? "" : "."), js->keys[i]);
+
+    local.key = key;
+
+    if (NULL != (found = (struct bulkValue *)zbx_hashset_search(&index->values, &local)))
+    {
+        found->value = zbx_strdup(found->value, value);
+        return 0;
+    }
+
+    local.key = zbx_strdup(NULL, key);
+    local.value = zbx_strdup(NULL, value);
+    zbx_hashset_insert(&index->values, &local, sizeof(local));
+
+    if (index->rollups.num_data != 0)
+        bulk_rollup_add_all(index, key, value);
+
+    return 0;
+}
+
+/*
+Adds an empty index of the subtree the cache key points to.
+*/
+static struct bulkIndex *bulk_index_create(const char *key)
+{
+    struct bulkIndex local;
+
+    memset(&local, 0, sizeof(local));
+    local.key = zbx_strdup(NULL, key);
+    zbx_hashset_create_ext(&local.values, 64, STRING_PTR_HASH_FUNC,
+                           ZBX_DEFAULT_STRING_COMPARE_FUNC, bulk_value_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC,
+                           ZBX_DEFAULT_MEM_REALLOC_FUNC, ZBX_DEFAULT_MEM_FREE_FUNC);
+    zbx_hashset_create_ext(&local.rollups, 4, STRING_PTR_HASH_FUNC,
+                           ZBX_DEFAULT_STRING_COMPARE_FUNC, bulk_rollup_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC,
+                           ZBX_DEFAULT_MEM_REALLOC_FUNC, ZBX_DEFAULT_MEM_FREE_FUNC);
+
+    return (struct bulkIndex *)zbx_hashset_insert(&indexes, &local, sizeof(local));
+}
+
+/*
+Returns the flattened subtree the request points to, fetching the subtree when the index is
+missing or older than the cache ttl, or NULL if it could not be fetched. The rollups of the
+index are recomputed while it is rebuilt. An index restored from the snapshot is returned
+as is until it could be rebuilt once.
+*/
+static struct bulkIndex *bulk_index(struct fetchContext *ctx, const struct itemRequest *item)
+{
+    struct bulkIndex *index;
+    struct bulkRollup *rollup;
+    zbx_hashset_iter_t iter;
+    struct jsonScanner js;
+    char *data;
+    double started;
+
+    if (NULL == (index = (struct bulkIndex *)zbx_hashset_search(&indexes, &item->key)))
+        index = bulk_index_create(item->key);
+
+    if (index->created + item->profile->cacheTtl <= zbx_time())
+    {
+        if ((data = collector_get(item, NULL)) == NULL)
+            data = fetch_shared(ctx, item->key, item->fullURL, item->user, item->password, item->profile);
+
+        if (data == NULL)
+        {
+            if (index->stale == 0 || snapshot_usable(index->stale) != SUCCEED)
+                return NULL;
+
+            zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - serving the snapshot of %s (%s:%d)",
+                       MODULE_NAME, item->fullURL, __FILE__, __LINE__ );
+            stats.stale++;
+            return index;
+        }
+
+        started = zbx_time();
+        zbx_hashset_clear(&index->values);
+
+        zbx_hashset_iter_reset(&index->rollups, &iter);
+
+        while (NULL != (rollup = (struct bulkRollup *)zbx_hashset_iter_next(&iter)))
+            bulk_rollup_reset(rollup);
+
+        json_scan_init(&js, bulk_index_value, index);
+
+        if (json_scan(&js, data, strlen(data)) == JSON_SCAN_ERROR)
+        {
+            zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not parse subtree: %s (%s:%d)", 
+                       MODULE_NAME, item->fullURL, __FILE__, __LINE__ );
+        }
+
+        index->created = zbx_time();
+        index->stale = 0;
+        stats_parse(index->created - started);
+        stats.misses++;
+
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - indexed %d values from %s (%s:%d)", 
+                   MODULE_NAME, index->values.num_data, item->fullURL, __FILE__, __LINE__ );
+        zbx_free(data);
+    }
+    else
+    {
+        if (index->stale != 0)
+            stats.stale++;
+
+        stats.hits++;
+    }
+
+    return index;
+}
+
+/*
+Looks indexKey up in the flattened subtree the request points to. Returns a copy of the value,
+or NULL if it is not there or the subtree could not be fetched.
+*/
+char *bulk_get(struct fetchContext *ctx, const struct itemRequest *item, const char *indexKey)
+{
+    struct bulkIndex *index;
+    struct bulkValue *value, localValue;
+
+    if (NULL == (index = bulk_index(ctx, item)))
+        return NULL;
+
+    localValue.key = (char *)indexKey;
+
+    if (NULL == (value = (struct bulkValue *)zbx_hashset_search(&index->values, &localValue)))
+        return NULL;
+
+    return zbx_strdup(NULL, value->value);
+}
+
+/*
+Returns the rollup of statistic, "name.field", over the applications or servlets of the
+applications subtree the request points to, or NULL if the subtree could not be fetched. A
+rollup asked for the first time is computed from the index, after that it is kept up to date
+while the index is rebuilt. The rollup stays valid until the next bulk call.
+*/
+struct bulkRollup *bulk_rollup(struct fetchContext *ctx, const struct itemRequest *item, int scope,
+                               const char *statistic)
+{
+    struct bulkIndex *index;
+    struct bulkRollup *rollup, local;
+    struct bulkValue *value;
+    zbx_hashset_iter_t iter;
+    char *key;
+
+    if (NULL == (index = bulk_index(ctx, item)))
+        return NULL;
+
+    key = zbx_dsprintf(NULL, "%d %s", scope, statistic);
+    local.key = key;
+
+    if (NULL != (rollup = (struct bulkRollup *)zbx_hashset_search(&index->rollups, &local)))
+    {
+        zbx_free(key);
+        return rollup;
+    }
+
+    memset(&local, 0, sizeof(local));
+    local.key = key;
+    local.scope = scope;
+    local.suffix = zbx_dsprintf(NULL, ".%s", statistic);
+    zbx_hashset_create_ext(&local.applications, 16, STRING_PTR_HASH_FUNC, ZBX_DEFAULT_STRING_COMPARE_FUNC,
+                           rollup_application_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+                           ZBX_DEFAULT_MEM_FREE_FUNC);
+    rollup = (struct bulkRollup *)zbx_hashset_insert(&index->rollups, &local, sizeof(local));
+
+    zbx_hashset_iter_reset(&index->values, &iter);
+
+    while (NULL != (value = (struct bulkValue *)zbx_hashset_iter_next(&iter)))
+        bulk_rollup_add(rollup, value->key, value->value);
+
+    return rollup;
+}
+
+/*
+Adds the response bodies and bulk indexes to the snapshot. What was restored from the
+snapshot and not refreshed since is left to the copy in the file.
+*/
+void cache_snapshot_save(struct snapshotWriter *w)
+{
+    zbx_hashset_iter_t iter, valueIter;
+    struct cacheEntry *entry;
+    struct bulkIndex *index;
+    struct bulkValue *value;
+    unsigned int count;
+
+    zbx_hashset_iter_reset(&cache, &iter);
+
+    while (NULL != (entry = (struct cacheEntry *)zbx_hashset_iter_next(&iter)))
+    {
+        if (entry->stale != 0)
+            continue;
+
+        snapshot_record_begin(w, SNAPSHOT_BODY, entry->created, entry->key);
+        snapshot_put_string(w, entry->data);
+        snapshot_put_string(w, entry->validators.etag);
+        snapshot_put_string(w, entry->validators.lastModified);
+        snapshot_put(w, &entry->ttl, sizeof(entry->ttl));
+        snapshot_put(w, entry->digest, sizeof(entry->digest));
+        snapshot_record_end(w);
+    }
+
+    zbx_hashset_iter_reset(&indexes, &iter);
+
+    while (NULL != (index = (struct bulkIndex *)zbx_hashset_iter_next(&iter)))
+    {
+        if (index->stale != 0 || index->created == 0)
+            continue;
+
+        count = (unsigned int)index->values.num_data;
+
+        snapshot_record_begin(w, SNAPSHOT_INDEX, index->created, index->key);
+        snapshot_put(w, &count, sizeof(count));
+
+        zbx_hashset_iter_reset(&index->values, &valueIter);
+
+        while (NULL != (value = (struct bulkValue *)zbx_hashset_iter_next(&valueIter)))
+        {
+            snapshot_put_string(w, value->key);
+            snapshot_put_string(w, value->value);
+        }
+
+        snapshot_record_end(w);
+    }
+}
+
+/*
+*/
+static int cache_snapshot_load_body(double time, const char *key, struct snapshotReader *r)
+{
+    struct cacheEntry local;
+    const char *data, *etag, *lastModified;
+
+    data = snapshot_get_string(r);
+    etag = snapshot_get_string(r);
+    lastModified = snapshot_get_string(r);
+
+    memset(&local, 0, sizeof(local));
+    snapshot_get(r, &local.ttl, sizeof(local.ttl));
+    snapshot_get(r, local.digest, sizeof(local.digest));
+
+    if (r->error != 0 || data == NULL || local.ttl <= 0 || cache.num_data >= CACHE_MAX_ENTRIES ||
+        zbx_hashset_search(&cache, &key) != NULL)
+    {
+        return FAIL;
+    }
+
+    local.key = zbx_strdup(NULL, key);
+    local.data = zbx_strdup(NULL, data);
+    local.validators.etag = (etag != NULL ? zbx_strdup(NULL, etag) : NULL);
+    local.validators.lastModified = (lastModified != NULL ? zbx_strdup(NULL, lastModified) : NULL);
+    local.created = snapshot_refresh_time(key, MIN(local.ttl, glassfishConfig.defaults.cacheTtl)) - local.ttl;
+    local.stale = time;
+    local.version = cache_version_next();
+
+    zbx_hashset_insert(&cache, &local, sizeof(local));
+
+    return SUCCEED;
+}
+
+/*
+*/
+static int cache_snapshot_load_index(double time, const char *key, struct snapshotReader *r)
+{
+    struct bulkIndex *index;
+    struct bulkValue local;
+    const char *valueKey, *value;
+    unsigned int count, i;
+
+    if (snapshot_get(r, &count, sizeof(count)) != SUCCEED || zbx_hashset_search(&indexes, &key) != NULL)
+        return FAIL;
+
+    index = bulk_index_create(key);
+
+    for (i = 0; i < count; i++)
+    {
+        valueKey = snapshot_get_string(r);
+        value = snapshot_get_string(r);
+
+        if (r->error != 0 || valueKey == NULL || value == NULL)
+        {
+            zbx_hashset_remove_direct(&indexes, index);
+            return FAIL;
+        }
+
+        local.key = zbx_strdup(NULL, valueKey);
+        local.value = zbx_strdup(NULL, value);
+        zbx_hashset_insert(&index->values, &local, sizeof(local));
+    }
+
+    index->created = snapshot_refresh_time(key, glassfishConfig.defaults.cacheTtl) - glassfishConfig.defaults.cacheTtl;
+    index->stale = time;
+
+    return SUCCEED;
+}
+
+/*
+Restores a response body or bulk index saved by cache_snapshot_save(). Returns FAIL if the
+record is damaged or the cache already holds the key.
+*/
+int cache_snapshot_load(int type, double time, const char *key, struct snapshotReader *r)
+{
+    int ret;
+
+    if (type == SNAPSHOT_BODY)
+        ret = cache_snapshot_load_body(time, key, r);
+    else
+        ret = cache_snapshot_load_index(time, key, r);
+
+    if (ret == SUCCEED)
+        stats.restored++;
+
+    return ret;
+}
@@ -0,0 +1,608 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include "md5.h"
+#include <curl/curl.h>
+#include <pthread.h>
+#include <signal.h>
+#include "glassfish.h"
+
+/*
+Endpoint polled by the collector thread. It is polled every collector_interval while its body
+changes, and half as often every time it comes back unchanged, up to COLLECTOR_MAX_INTERVAL.
+*/
+struct collectorEndpoint
+{
+    char *key;
+    char *fullURL;
+    char *user;
+    char *password;
+    const struct targetProfile *profile;
+    time_t lastRead;
+    struct fetchValidators validators;
+    md5_byte_t digest[MD5_DIGEST_SIZE];
+    zbx_uint64_t version;
+    double interval;
+    double nextFetch;
+};
+
+/* immutable once published, except for lastRead which readers refresh */
+struct snapshotEntry
+{
+    char *key;
+    char *data;
+    double fetched;
+    zbx_uint64_t version;
+    time_t lastRead;
+};
+
+struct snapshot
+{
+    double created;
+    zbx_hashset_t entries;
+    struct snapshot *next;
+};
+
+struct collector
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pid_t pid;
+    int running;
+    int stop;
+    zbx_hashset_t endpoints;    /* owned by the collector thread */
+    zbx_hashset_t pending;      /* subscriptions from item handlers, guarded by lock */
+    struct snapshot *current;   /* swapped atomically */
+    struct snapshot *hazard;    /* snapshot the item handler is reading */
+    struct snapshot *retired;   /* replaced snapshots not freed yet */
+};
+
+static struct collector collector;
+
+/*
+*/
+static void collector_endpoint_clean(void *data)
+{
+    struct collectorEndpoint *endpoint = (struct collectorEndpoint *)data;
+
+    zbx_free(endpoint->key);
+    zbx_free(endpoint->fullURL);
+    zbx_free(endpoint->user);
+    zbx_free(endpoint->password);
+    zbx_free(endpoint->validators.etag);
+    zbx_free(endpoint->validators.lastModified);
+}
+
+/*
+*/
+static void snapshot_entry_clean(void *data)
+{
+    struct snapshotEntry *entry = (struct snapshotEntry *)data;
+
+    zbx_free(entry->key);
+    zbx_free(entry->data);
+}
+
+/*
+*/
+static void collector_hashset_create(zbx_hashset_t *hs, zbx_clean_func_t clean)
+{
+    zbx_hashset_create_ext(hs, 64, STRING_PTR_HASH_FUNC, ZBX_DEFAULT_STRING_COMPARE_FUNC, clean,
+                           ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC, ZBX_DEFAULT_MEM_FREE_FUNC);
+}
+
+/*
+*/
+static void snapshot_free(struct snapshot *snap)
+{
+    if (snap == NULL)
+        return;
+
+    zbx_hashset_destroy(&snap->entries);
+    zbx_free(snap);
+}
+
+/*
+Frees replaced snapshots, except the one the item handler announced it is reading.
+*/
+static void collector_reclaim(void)
+{
+    struct snapshot **prev = &collector.retired, *snap, *hazard;
+
+    hazard = __atomic_load_n(&collector.hazard, __ATOMIC_SEQ_CST);
+
+    while (NULL != (snap = *prev))
+    {
+        if (snap == hazard)
+        {
+            prev = &snap->next;
+            continue;
+        }
+
+        *prev = snap->next;
+        snapshot_free(snap);
+    }
+}
+
+/*
+Moves new subscriptions to the endpoint set and drops endpoints nobody asked for during
+collector_idle_timeout.
+*/
+static void collector_sync_endpoints(time_t now)
+{
+    zbx_hashset_iter_t iter;
+    struct collectorEndpoint *endpoint, *found;
+
+    pthread_mutex_lock(&collector.lock);
+
+    zbx_hashset_iter_reset(&collector.pending, &iter);
+
+    while (NULL != (endpoint = (struct collectorEndpoint *)zbx_hashset_iter_next(&iter)))
+    {
+        if (NULL == (found = (struct collectorEndpoint *)zbx_hashset_search(&collector.endpoints, endpoint)))
+        {
+            zbx_hashset_insert(&collector.endpoints, endpoint, sizeof(*endpoint));
+            memset(endpoint, 0, sizeof(*endpoint));
+        }
+        else if (endpoint->lastRead > found->lastRead)
+            found->lastRead = endpoint->lastRead;
+
+        zbx_hashset_iter_remove(&iter);
+    }
+
+    pthread_mutex_unlock(&collector.lock);
+
+    zbx_hashset_iter_reset(&collector.endpoints, &iter);
+
+    while (NULL != (endpoint = (struct collectorEndpoint *)zbx_hashset_iter_next(&iter)))
+    {
+        if (endpoint->lastRead + glassfishConfig.collectorIdleTimeout < now)
+        {
+            zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - collector drops idle endpoint: %s (%s:%d)",
+                       MODULE_NAME, endpoint->fullURL, __FILE__, __LINE__ );
+            zbx_hashset_iter_remove(&iter);
+        }
+    }
+}
+
+/*
+Carries the read times recorded by item handlers in the published snapshot over to the
+endpoints and to the snapshot about to replace it. Done right before the swap, so reads
+made while the new snapshot was being collected are not lost.
+*/
+static void collector_merge_reads(struct snapshot *previous, struct snapshot *snap)
+{
+    zbx_hashset_iter_t iter;
+    struct collectorEndpoint *endpoint;
+    struct snapshotEntry *entry;
+    time_t lastRead;
+
+    zbx_hashset_iter_reset(&collector.endpoints, &iter);
+
+    while (NULL != (endpoint = (struct collectorEndpoint *)zbx_hashset_iter_next(&iter)))
+    {
+        if (previous != NULL && NULL != (entry = (struct snapshotEntry *)zbx_hashset_search(&previous->entries, endpoint)))
+        {
+            lastRead = __atomic_load_n(&entry->lastRead, __ATOMIC_RELAXED);
+
+            if (lastRead > endpoint->lastRead)
+                endpoint->lastRead = lastRead;
+        }
+
+        if (NULL != (entry = (struct snapshotEntry *)zbx_hashset_search(&snap->entries, endpoint)))
+            entry->lastRead = endpoint->lastRead;
+    }
+}
+
+/*
+Tells whether the body received for endpoint differs from the previous one and updates the
+polling interval accordingly. data is NULL if GlassFish answered 304.
+*/
+static int collector_changed(struct collectorEndpoint *endpoint, const char *data, double now)
+{
+    md5_state_t state;
+    md5_byte_t digest[MD5_DIGEST_SIZE];
+    int changed = 1;
+
+    if (data != NULL)
+    {
+        zbx_md5_init(&state);
+        zbx_md5_append(&state, (const md5_byte_t *)data, strlen(data));
+        zbx_md5_finish(&state, digest);
+    }
+
+    if (endpoint->version != 0 && (data == NULL || memcmp(digest, endpoint->digest, sizeof(digest)) == 0))
+    {
+        endpoint->interval = MIN(endpoint->interval * 2, COLLECTOR_MAX_INTERVAL);
+        changed = 0;
+    }
+    else
+    {
+        endpoint->interval = glassfishConfig.collectorInterval;
+        endpoint->version = cache_version_next();
+        memcpy(endpoint->digest, digest, sizeof(digest));
+    }
+
+    endpoint->nextFetch = now + endpoint->interval;
+
+    return changed;
+}
+
+/*
+Fetches the endpoints that are due concurrently into a new snapshot, so a cycle takes about
+as long as the slowest endpoint. Requests are conditional, an endpoint that did not change
+keeps its previous body and version. Endpoints another agent process collected during the
+interval are taken from shared memory, those it is collecting right now, those that are not
+due yet and those that failed or did not answer 200 keep their previous body.
+*/
+static struct snapshot *collector_collect(CURLM *multi, struct snapshot *previous)
+{
+    zbx_hashset_iter_t iter;
+    struct collectorEndpoint *endpoint, **endpoints;
+    struct fetchRequest *requests;
+    struct snapshotEntry local, *old;
+    struct snapshot *snap;
+    char **shared, *data;
+    int *slots, *fetchIndex, i, j, count = 0, fetchCount = 0;
+    long status;
+    double now = zbx_time();
+
+    snap = (struct snapshot *)zbx_malloc(NULL, sizeof(struct snapshot));
+    snap->next = NULL;
+    collector_hashset_create(&snap->entries, snapshot_entry_clean);
+
+    endpoints = (struct collectorEndpoint **)zbx_malloc(NULL, sizeof(*endpoints) * (collector.endpoints.num_data + 1));
+    requests = (struct fetchRequest *)zbx_malloc(NULL, sizeof(*requests) * (collector.endpoints.num_data + 1));
+    shared = (char **)zbx_malloc(NULL, sizeof(*shared) * (collector.endpoints.num_data + 1));
+    slots = (int *)zbx_malloc(NULL, sizeof(*slots) * (collector.endpoints.num_data + 1));
+    fetchIndex = (int *)zbx_malloc(NULL, sizeof(*fetchIndex) * (collector.endpoints.num_data + 1));
+
+    zbx_hashset_iter_reset(&collector.endpoints, &iter);
+
+    while (NULL != (endpoint = (struct collectorEndpoint *)zbx_hashset_iter_next(&iter)))
+    {
+        endpoints[count] = endpoint;
+        fetchIndex[count] = -1;
+        shared[count] = NULL;
+        slots[count] = -1;
+
+        /* the next cycle is at most half an interval late, that is close enough */
+        if (endpoint->version != 0 && endpoint->nextFetch > now + glassfishConfig.collectorInterval / 2.0)
+        {
+            count++;
+            continue;
+        }
+
+        if (shm_lookup(endpoint->key, glassfishConfig.collectorInterval, &shared[count], &slots[count]) == SHM_CLAIMED)
+        {
+            requests[fetchCount].fullURL = endpoint->fullURL;
+            requests[fetchCount].user = endpoint->user;
+            requests[fetchCount].password = endpoint->password;
+            requests[fetchCount].profile = endpoint->profile;
+            requests[fetchCount].validators = (endpoint->version != 0 ? &endpoint->validators : NULL);
+            fetchIndex[count] = fetchCount++;
+        }
+
+        count++;
+    }
+
+    fetch_multi(multi, requests, fetchCount, zbx_time() + glassfishConfig.collectorDeadline);
+
+    for (i = 0; i < count; i++)
+    {
+        endpoint = endpoints[i];
+        local.key = endpoint->key;
+        local.lastRead = endpoint->lastRead;
+        local.fetched = zbx_time();
+        old = (previous != NULL ? (struct snapshotEntry *)zbx_hashset_search(&previous->entries, &local) : NULL);
+        data = shared[i];
+        status = (data != NULL ? 200 : 0);
+
+        if ((j = fetchIndex[i]) != -1)
+        {
+            data = requests[j].data;
+            status = requests[j].status;
+
+            /* only a 200 carries the resource, anything else keeps the previous body */
+            if (data != NULL && status != 200)
+            {
+                zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - status %ld, previous response kept: %s (%s:%d)",
+                           MODULE_NAME, status, endpoint->fullURL, __FILE__, __LINE__ );
+                zbx_free(data);
+            }
+
+            if (data != NULL)
+                shm_store(slots[i], endpoint->key, data);
+            else if (status == 304 && old != NULL)
+                shm_store(slots[i], endpoint->key, old->data);
+            else
+                shm_fail(slots[i]);
+
+            /* the validators may belong to a response that was not received completely */
+            if (data == NULL && status != 304)
+            {
+                zbx_free(endpoint->validators.etag);
+                zbx_free(endpoint->validators.lastModified);
+            }
+        }
+
+        /* without a previous body the next response is taken as changed whatever it is */
+        if (old == NULL)
+            endpoint->version = 0;
+
+        if (data == NULL && (status != 304 || old == NULL))
+        {
+            if (old == NULL)
+                continue;
+
+            local.data = zbx_strdup(NULL, old->data);
+            local.fetched = old->fetched;
+        }
+        else if (collector_changed(endpoint, data, now) != 0)
+        {
+            local.data = data;
+        }
+        else
+        {
+            zbx_free(data);
+            local.data = zbx_strdup(NULL, old->data);
+        }
+
+        local.version = endpoint->version;
+        local.key = zbx_strdup(NULL, endpoint->key);
+        zbx_hashset_insert(&snap->entries, &local, sizeof(local));
+    }
+
+    zbx_free(fetchIndex);
+    zbx_free(slots);
+    zbx_free(shared);
+    zbx_free(requests);
+    zbx_free(endpoints);
+
+    snap->created = zbx_time();
+
+    return snap;
+}
+
+/*
+*/
+static void *collector_thread(void *args)
+{
+    CURLM *multi;
+    struct snapshot *snap, *previous;
+    struct timespec deadline;
+    double now;
+
+    ZBX_UNUSED(args);
+
+    if (NULL == (multi = fetch_multi_init()))
+    {
+        zabbix_log(LOG_LEVEL_ERR, "Error in module: %s - collector could not initilization libcurl (%s:%d)",
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return NULL;
+    }
+
+    for (;;)
+    {
+        now = zbx_time();
+        previous = __atomic_load_n(&collector.current, __ATOMIC_ACQUIRE);
+
+        collector_sync_endpoints((time_t)now);
+
+        snap = collector_collect(multi, previous);
+        collector_merge_reads(previous, snap);
+        previous = __atomic_exchange_n(&collector.current, snap, __ATOMIC_SEQ_CST);
+
+        if (previous != NULL)
+        {
+            previous->next = collector.retired;
+            collector.retired = previous;
+        }
+
+        collector_reclaim();
+
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - collector published %d entries in %.3f sec (%s:%d)",
+                   MODULE_NAME, snap->entries.num_data, zbx_time() - now, __FILE__, __LINE__ );
+
+        pthread_mutex_lock(&collector.lock);
+
+        deadline.tv_sec = (time_t)now + glassfishConfig.collectorInterval;
+        deadline.tv_nsec = 0;
+
+        while (collector.stop == 0 && pthread_cond_timedwait(&collector.wakeup, &collector.lock, &deadline) == 0)
+            ;
+
+        if (collector.stop != 0)
+        {
+            pthread_mutex_unlock(&collector.lock);
+            break;
+        }
+
+        pthread_mutex_unlock(&collector.lock);
+    }
+
+    curl_multi_cleanup(multi);
+
+    return NULL;
+}
+
+/*
+Starts the thread in the calling process. Threads do not survive the fork of the agent
+collectors, so this happens on first use rather than in zbx_module_init.
+*/
+static void collector_start(void)
+{
+    sigset_t mask, orig;
+
+    collector.pid = getpid();
+    collector.running = 0;
+    collector.stop = 0;
+    collector.current = NULL;
+    collector.hazard = NULL;
+    collector.retired = NULL;
+
+    pthread_mutex_init(&collector.lock, NULL);
+    pthread_cond_init(&collector.wakeup, NULL);
+    collector_hashset_create(&collector.endpoints, collector_endpoint_clean);
+    collector_hashset_create(&collector.pending, collector_endpoint_clean);
+
+    /* signals are handled by the agent process, not by the collector */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, &orig);
+
+    if (pthread_create(&collector.thread, NULL, collector_thread, NULL) == 0)
+        collector.running = 1;
+    else
+        zabbix_log(LOG_LEVEL_ERR, "Error in module: %s - could not start collector thread (%s:%d)",
+                   MODULE_NAME, __FILE__, __LINE__ );
+
+    pthread_sigmask(SIG_SETMASK, &orig, NULL);
+}
+
+/*
+*/
+void collector_init(void)
+{
+    memset(&collector, 0, sizeof(collector));
+}
+
+/*
+*/
+void collector_uninit(void)
+{
+    if (collector.pid != getpid())
+        return;
+
+    if (collector.running != 0)
+    {
+        pthread_mutex_lock(&collector.lock);
+        collector.stop = 1;
+        pthread_cond_signal(&collector.wakeup);
+        pthread_mutex_unlock(&collector.lock);
+
+        pthread_join(collector.thread, NULL);
+        collector.running = 0;
+    }
+
+    collector.hazard = NULL;
+    collector_reclaim();
+    snapshot_free(collector.current);
+    zbx_hashset_destroy(&collector.endpoints);
+    zbx_hashset_destroy(&collector.pending);
+    pthread_cond_destroy(&collector.wakeup);
+    pthread_mutex_destroy(&collector.lock);
+    collector.pid = 0;
+}
+
+/*
+Publishes the current snapshot as a hazard pointer, the collector does not free it until
+snapshot_release(). Only the item handler thread of the process reads snapshots.
+*/
+static struct snapshot *snapshot_acquire(void)
+{
+    struct snapshot *snap;
+
+    do
+    {
+        snap = __atomic_load_n(&collector.current, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&collector.hazard, snap, __ATOMIC_SEQ_CST);
+    }
+    while (snap != __atomic_load_n(&collector.current, __ATOMIC_SEQ_CST));
+
+    return snap;
+}
+
+/*
+*/
+static void snapshot_release(void)
+{
+    __atomic_store_n(&collector.hazard, NULL, __ATOMIC_SEQ_CST);
+}
+
+/*
+Returns a copy of the collected body for the request, or NULL if the endpoint is not
+collected yet or the snapshot is too old; in that case the endpoint is subscribed and the
+caller fetches it itself. *version, if given, is set to the version of the body. Lookups take
+no lock.
+*/
+char *collector_get(const struct itemRequest *item, zbx_uint64_t *version)
+{
+    struct snapshot *snap;
+    struct snapshotEntry *entry;
+    struct collectorEndpoint local;
+    char *data = NULL;
+    double now;
+
+    if (glassfishConfig.collectorInterval == 0)
+        return NULL;
+
+    if (collector.pid != getpid())
+        collector_start();
+
+    if (collector.running == 0)
+        return NULL;
+
+    now = zbx_time();
+
+    snap = snapshot_acquire();
+
+    if (snap != NULL && snap->created + COLLECTOR_MAX_AGE > now &&
+        NULL != (entry = (struct snapshotEntry *)zbx_hashset_search(&snap->entries, &item->key)))
+    {
+        __atomic_store_n(&entry->lastRead, (time_t)now, __ATOMIC_RELAXED);
+        data = zbx_strdup(NULL, entry->data);
+
+        if (version != NULL)
+            *version = entry->version;
+    }
+
+    snapshot_release();
+
+    if (data != NULL)
+        return data;
+
+    memset(&local, 0, sizeof(local));
+    local.key = item->key;
+    local.lastRead = (time_t)now;
+
+    pthread_mutex_lock(&collector.lock);
+
+    if (NULL == zbx_hashset_search(&collector.pending, &local))
+    {
+        local.key = zbx_strdup(NULL, item->key);
+        local.fullURL = zbx_strdup(NULL, item->fullURL);
+        local.user = zbx_strdup(NULL, item->user);
+        local.password = zbx_strdup(NULL, item->password);
+        local.profile = item->profile;
+        zbx_hashset_insert(&collector.pending, &local, sizeof(local));
+    }
+
+    pthread_mutex_unlock(&collector.lock);
+
+    return NULL;
+}
+
+/*
+Seconds since the collector published its last snapshot. Returns FAIL if there is none.
+*/
+int collector_age(double *age)
+{
+    struct snapshot *snap;
+
+    if (glassfishConfig.collectorInterval == 0 || collector.pid != getpid())
+        return FAIL;
+
+    if (NULL == (snap = snapshot_acquire()))
+    {
+        snapshot_release();
+        return FAIL;
+    }
+
+    *age = zbx_time() - snap->created;
+    snapshot_release();
+
+    return SUCCEED;
+}
@@ -0,0 +1,372 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include <curl/curl.h>
+#include <stddef.h>
+#include "glassfish.h"
+
+/*
+glassfish.conf is read once by zbx_module_init. Settings before any section or in [global]
+tune the module, every other [name] section is a target profile item keys can refer to:
+
+    [global]
+    cache_ttl = 30
+    collector_interval = 30
+    snapshot_file = /var/lib/zabbix/glassfish.snapshot
+    snapshot_interval = 300
+
+    [prod]
+    url = https://das.example.com
+    port = 4848
+    user = monitor
+    password = secret
+    ssl_verify_peer = 1
+
+A profile takes what it does not set from [global]. snapshot_interval is how often every
+agent process saves its state to snapshot_file, 0 disables the snapshot. Lines starting
+with # are comments.
+*/
+struct moduleConfig glassfishConfig;
+
+#define CONFIG_STRING   0
+#define CONFIG_INT      1
+
+struct configOption
+{
+    const char *name;
+    int type;
+    size_t offset;
+    int min;
+    int max;
+};
+
+/* settings of a target, in a profile or, as defaults, in [global] */
+static const struct configOption profileOptions[] =
+{
+    {"url",                     CONFIG_STRING,  offsetof(struct targetProfile, url),            0, 0},
+    {"port",                    CONFIG_STRING,  offsetof(struct targetProfile, port),           0, 0},
+    {"user",                    CONFIG_STRING,  offsetof(struct targetProfile, user),           0, 0},
+    {"password",                CONFIG_STRING,  offsetof(struct targetProfile, password),       0, 0},
+    {"ssl_verify_peer",         CONFIG_INT,     offsetof(struct targetProfile, sslVerifyPeer),  0, 1},
+    {"ssl_verify_host",         CONFIG_INT,     offsetof(struct targetProfile, sslVerifyHost),  0, 2},
+    {"connect_timeout",         CONFIG_INT,     offsetof(struct targetProfile, connectTimeout), 1, 3600},
+    {"timeout",                 CONFIG_INT,     offsetof(struct targetProfile, timeout),        1, 3600},
+    {"cache_ttl",               CONFIG_INT,     offsetof(struct targetProfile, cacheTtl),       1, 86400},
+    {NULL}
+};
+
+/* settings of the module, only in [global] */
+static const struct configOption globalOptions[] =
+{
+    {"pool_idle_timeout",       CONFIG_INT,     offsetof(struct moduleConfig, poolIdleTimeout),      1, 86400},
+    {"pool_max_lifetime",       CONFIG_INT,     offsetof(struct moduleConfig, poolMaxLifetime),      1, 604800},
+    {"pool_keepalive_idle",     CONFIG_INT,     offsetof(struct moduleConfig, poolKeepaliveIdle),    1, 86400},
+    {"cache_max_ttl",           CONFIG_INT,     offsetof(struct moduleConfig, cacheMaxTtl),          1, 86400},
+    {"collector_interval",      CONFIG_INT,     offsetof(struct moduleConfig, collectorInterval),    0, 86400},
+    {"collector_idle_timeout",  CONFIG_INT,     offsetof(struct moduleConfig, collectorIdleTimeout), 1, 86400},
+    {"collector_deadline",      CONFIG_INT,     offsetof(struct moduleConfig, collectorDeadline),    1, 3600},
+    {"multi_host_connections",  CONFIG_INT,     offsetof(struct moduleConfig, multiHostConnections), 1, 1024},
+    {"multi_max_connections",   CONFIG_INT,     offsetof(struct moduleConfig, multiMaxConnections),  1, 1024},
+    {"breaker_failures",        CONFIG_INT,     offsetof(struct moduleConfig, breakerFailures),      1, 1000},
+    {"breaker_backoff",         CONFIG_INT,     offsetof(struct moduleConfig, breakerBackoff),       1, 86400},
+    {"breaker_max_backoff",     CONFIG_INT,     offsetof(struct moduleConfig, breakerMaxBackoff),    1, 86400},
+    {"snapshot_file",           CONFIG_STRING,  offsetof(struct moduleConfig, snapshotFile),         0, 0},
+    {"snapshot_interval",       CONFIG_INT,     offsetof(struct moduleConfig, snapshotInterval),     0, 86400},
+    {"snapshot_max_age",        CONFIG_INT,     offsetof(struct moduleConfig, snapshotMaxAge),       1, 604800},
+    {"debug",                   CONFIG_INT,     offsetof(struct moduleConfig, debug),                0, 1},
+    {NULL}
+};
+
+/*
+*/
+static void config_profile_clean(struct targetProfile *profile)
+{
+    zbx_free(profile->name);
+    zbx_free(profile->url);
+    zbx_free(profile->port);
+    zbx_free(profile->user);
+    zbx_free(profile->password);
+}
+
+/*
+Settings a profile does not set are -1 or NULL until config_load() fills them in.
+*/
+static void config_profile_reset(struct targetProfile *profile, const char *name)
+{
+    memset(profile, 0, sizeof(*profile));
+    profile->name = zbx_strdup(NULL, name);
+    profile->sslVerifyPeer = -1;
+    profile->sslVerifyHost = -1;
+    profile->connectTimeout = -1;
+    profile->timeout = -1;
+    profile->cacheTtl = -1;
+}
+
+/*
+Compiled-in defaults, the values of the #defines in glassfish.h.
+*/
+static void config_defaults(void)
+{
+    memset(&glassfishConfig, 0, sizeof(glassfishConfig));
+
+    glassfishConfig.defaults.name = zbx_strdup(NULL, "global");
+    glassfishConfig.defaults.user = zbx_strdup(NULL, "");
+    glassfishConfig.defaults.password = zbx_strdup(NULL, "");
+    glassfishConfig.defaults.sslVerifyPeer = SSL_VERIFYPEER;
+    glassfishConfig.defaults.sslVerifyHost = SSL_VERIFYHOST;
+    glassfishConfig.defaults.connectTimeout = HTTP_CONNECT_TIMEOUT;
+    glassfishConfig.defaults.timeout = HTTP_TIMEOUT;
+    glassfishConfig.defaults.cacheTtl = CACHE_TTL;
+
+    glassfishConfig.poolIdleTimeout = POOL_IDLE_TIMEOUT;
+    glassfishConfig.poolMaxLifetime = POOL_MAX_LIFETIME;
+    glassfishConfig.poolKeepaliveIdle = POOL_KEEPALIVE_IDLE;
+    glassfishConfig.cacheMaxTtl = CACHE_MAX_TTL;
+    glassfishConfig.collectorInterval = COLLECTOR_INTERVAL;
+    glassfishConfig.collectorIdleTimeout = COLLECTOR_IDLE_TIMEOUT;
+    glassfishConfig.collectorDeadline = COLLECTOR_DEADLINE;
+    glassfishConfig.multiHostConnections = MULTI_HOST_CONNECTIONS;
+    glassfishConfig.multiMaxConnections = MULTI_MAX_CONNECTIONS;
+    glassfishConfig.breakerFailures = BREAKER_FAILURES;
+    glassfishConfig.breakerBackoff = BREAKER_BACKOFF;
+    glassfishConfig.breakerMaxBackoff = BREAKER_MAX_BACKOFF;
+    glassfishConfig.snapshotFile = zbx_strdup(NULL, SNAPSHOT_FILE);
+    glassfishConfig.snapshotInterval = SNAPSHOT_INTERVAL;
+    glassfishConfig.snapshotMaxAge = SNAPSHOT_MAX_AGE;
+    glassfishConfig.debug = DEBUG;
+}
+
+/*
+Stores value in the setting of base the option describes. Returns FAIL if the value is not
+a number within the limits of the option.
+*/
+static int config_option_set(const struct configOption *option, void *base, const char *value)
+{
+    char *end;
+    long number;
+
+    if (option->type == CONFIG_STRING)
+    {
+        char **target = (char **)((char *)base + option->offset);
+
+        *target = zbx_strdup(*target, value);
+        return SUCCEED;
+    }
+
+    number = strtol(value, &end, 10);
+
+    if (*value == '\0' || *end != '\0' || number < option->min || number > option->max)
+        return FAIL;
+
+    *(int *)((char *)base + option->offset) = (int)number;
+
+    return SUCCEED;
+}
+
+/*
+*/
+static const struct configOption *config_option_find(const struct configOption *options, const char *name)
+{
+    for (; options->name != NULL; options++)
+    {
+        if (strcmp(options->name, name) == 0)
+            return options;
+    }
+
+    return NULL;
+}
+
+/*
+Applies one "name = value" line to the profile being read, or to the module settings and
+the defaults if profile is NULL.
+*/
+static int config_line(struct targetProfile *profile, const char *name, const char *value)
+{
+    const struct configOption *option;
+
+    if (NULL != (option = config_option_find(profileOptions, name)))
+        return config_option_set(option, profile != NULL ? (void *)profile : (void *)&glassfishConfig.defaults, value);
+
+    if (profile == NULL && NULL != (option = config_option_find(globalOptions, name)))
+        return config_option_set(option, &glassfishConfig, value);
+
+    return FAIL;
+}
+
+/*
+Fills in what a profile did not set from [global], url and port included. Returns FAIL if
+neither the profile nor [global] sets a url or a port.
+*/
+static int config_profile_finish(struct targetProfile *profile)
+{
+    const struct targetProfile *defaults = &glassfishConfig.defaults;
+
+    if (profile->url == NULL && defaults->url != NULL)
+        profile->url = zbx_strdup(NULL, defaults->url);
+
+    if (profile->port == NULL && defaults->port != NULL)
+        profile->port = zbx_strdup(NULL, defaults->port);
+
+    if (profile->url == NULL || profile->port == NULL)
+        return FAIL;
+
+    if (profile->user == NULL)
+        profile->user = zbx_strdup(NULL, defaults->user);
+
+    if (profile->password == NULL)
+        profile->password = zbx_strdup(NULL, defaults->password);
+
+    if (profile->sslVerifyPeer == -1)
+        profile->sslVerifyPeer = defaults->sslVerifyPeer;
+
+    if (profile->sslVerifyHost == -1)
+        profile->sslVerifyHost = defaults->sslVerifyHost;
+
+    if (profile->connectTimeout == -1)
+        profile->connectTimeout = defaults->connectTimeout;
+
+    if (profile->timeout == -1)
+        profile->timeout = defaults->timeout;
+
+    if (profile->cacheTtl == -1)
+        profile->cacheTtl = defaults->cacheTtl;
+
+    return SUCCEED;
+}
+
+/*
+Loads the file named by the GLASSFISH_CONF environment variable, or GLASSFISH_CONF_FILE. A
+missing file leaves the compiled-in defaults. Returns FAIL on a line that cannot be used,
+the module is not loaded then.
+*/
+int config_load(void)
+{
+    FILE *file;
+    const char *path;
+    char line[CONFIG_LINE_LENGTH], *name, *value, *end;
+    struct targetProfile *profile = NULL;
+    int lineNumber = 0, i, ret = SUCCEED;
+
+    config_defaults();
+
+    if (NULL == (path = getenv("GLASSFISH_CONF")))
+        path = GLASSFISH_CONF_FILE;
+
+    if (NULL == (file = fopen(path, "r")))
+    {
+        zabbix_log(LOG_LEVEL_INFORMATION, "Module: %s - no configuration file %s, using defaults (%s:%d)",
+                   MODULE_NAME, path, __FILE__, __LINE__ );
+        return SUCCEED;
+    }
+
+    while (ret == SUCCEED && NULL != fgets(line, sizeof(line), file))
+    {
+        lineNumber++;
+        zbx_lrtrim(line, ZBX_WHITESPACE);
+
+        if (*line == '\0' || *line == '#')
+            continue;
+
+        if (*line == '[')
+        {
+            if (NULL == (end = strchr(line, ']')) || end[1] != '\0' || end == line + 1)
+            {
+                ret = FAIL;
+                break;
+            }
+
+            *end = '\0';
+            name = line + 1;
+
+            if (strcmp(name, "global") == 0)
+            {
+                profile = NULL;
+                continue;
+            }
+
+            if (config_profile(name) != NULL)
+            {
+                ret = FAIL;
+                break;
+            }
+
+            glassfishConfig.profiles = (struct targetProfile *)zbx_realloc(glassfishConfig.profiles,
+                                       sizeof(struct targetProfile) * (glassfishConfig.profileCount + 1));
+            profile = &glassfishConfig.profiles[glassfishConfig.profileCount++];
+            config_profile_reset(profile, name);
+            continue;
+        }
+
+        if (NULL == (value = strchr(line, '=')))
+        {
+            ret = FAIL;
+            break;
+        }
+
+        *value++ = '\0';
+        name = line;
+        zbx_rtrim(name, ZBX_WHITESPACE);
+        zbx_ltrim(value, ZBX_WHITESPACE);
+
+        ret = config_line(profile, name, value);
+    }
+
+    fclose(file);
+
+    if (ret != SUCCEED)
+    {
+        zabbix_log(LOG_LEVEL_ERR, "Error in module: %s - invalid line %d in %s (%s:%d)",
+                   MODULE_NAME, lineNumber, path, __FILE__, __LINE__ );
+        config_destroy();
+        return FAIL;
+    }
+
+    for (i = 0; i < glassfishConfig.profileCount; i++)
+    {
+        if (config_profile_finish(&glassfishConfig.profiles[i]) != SUCCEED)
+        {
+            zabbix_log(LOG_LEVEL_ERR, "Error in module: %s - profile [%s] in %s needs url and port, in the profile or in [global] (%s:%d)",
+                       MODULE_NAME, glassfishConfig.profiles[i].name, path, __FILE__, __LINE__ );
+            config_destroy();
+            return FAIL;
+        }
+    }
+
+    zabbix_log(LOG_LEVEL_INFORMATION, "Module: %s - loaded %s with %d profiles (%s:%d)",
+               MODULE_NAME, path, glassfishConfig.profileCount, __FILE__, __LINE__ );
+
+    return SUCCEED;
+}
+
+/*
+*/
+void config_destroy(void)
+{
+    int i;
+
+    for (i = 0; i < glassfishConfig.profileCount; i++)
+        config_profile_clean(&glassfishConfig.profiles[i]);
+
+    zbx_free(glassfishConfig.profiles);
+    glassfishConfig.profileCount = 0;
+    config_profile_clean(&glassfishConfig.defaults);
+    zbx_free(glassfishConfig.snapshotFile);
+}
+
+/*
+Returns the profile called name, or NULL if glassfish.conf has none.
+*/
+const struct targetProfile *config_profile(const char *name)
+{
+    int i;
+
+    for (i = 0; i < glassfishConfig.profileCount; i++)
+    {
+        if (strcmp(glassfishConfig.profiles[i].name, name) == 0)
+            return &glassfishConfig.profiles[i];
+    }
+
+    return NULL;
+}
@@ -0,0 +1,250 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include "zbxjson.h"
+#include "md5.h"
+#include <curl/curl.h>
+#include "glassfish.h"
+
+/* discovered names of one monitoring node, kept with the validators of the response; stale as in cacheEntry */
+struct discoveryEntry
+{
+    char *key;
+    char *lld;
+    struct fetchValidators validators;
+    md5_byte_t digest[MD5_DIGEST_SIZE];
+    double checked;
+    double stale;
+};
+
+struct discoveryBuilder
+{
+    struct zbx_json *j;
+    const char *macro;
+    int count;
+};
+
+static zbx_hashset_t discoveries;
+
+/*
+*/
+static void discovery_entry_clean(void *data)
+{
+    struct discoveryEntry *entry = (struct discoveryEntry *)data;
+
+    zbx_free(entry->key);
+    zbx_free(entry->lld);
+    zbx_free(entry->validators.etag);
+    zbx_free(entry->validators.lastModified);
+}
+
+/*
+*/
+void discovery_init(void)
+{
+    zbx_hashset_create_ext(&discoveries, 16, STRING_PTR_HASH_FUNC, ZBX_DEFAULT_STRING_COMPARE_FUNC,
+                           discovery_entry_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+                           ZBX_DEFAULT_MEM_FREE_FUNC);
+}
+
+/*
+*/
+void discovery_destroy(void)
+{
+    zbx_hashset_destroy(&discoveries);
+}
+
+/*
+Adds one LLD row per key of extraProperties.childResources, the values are only links.
+*/
+static int discovery_add_child(struct jsonScanner *js, const char *value, int isString, void *ctx)
+{
+    struct discoveryBuilder *builder = (struct discoveryBuilder *)ctx;
+
+    if (js->depth != 3 || strcmp(js->keys[0], "extraProperties") != 0 || strcmp(js->keys[1], "childResources") != 0)
+        return 0;
+
+    zbx_json_addobject(builder->j, NULL);
+    zbx_json_addstring(builder->j, builder->macro, js->keys[2], ZBX_JSON_TYPE_STRING);
+    zbx_json_close(builder->j);
+    builder->count++;
+
+    return 0;
+}
+
+/*
+*/
+static char *discovery_build(const char *data, const char *macro)
+{
+    struct zbx_json j;
+    struct jsonScanner js;
+    struct discoveryBuilder builder;
+    char *lld;
+    double started = zbx_time();
+
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    zbx_json_addarray(&j, ZBX_PROTO_TAG_DATA);
+
+    builder.j = &j;
+    builder.macro = macro;
+    builder.count = 0;
+
+    json_scan_init(&js, discovery_add_child, &builder);
+
+    if (json_scan(&js, data, strlen(data)) == JSON_SCAN_ERROR)
+    {
+        zbx_json_free(&j);
+        return NULL;
+    }
+
+    zbx_json_close(&j);
+    lld = zbx_strdup(NULL, j.buffer);
+    zbx_json_free(&j);
+
+    stats_parse(zbx_time() - started);
+
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - discovered %d %s (%s:%d)",
+               MODULE_NAME, builder.count, macro, __FILE__, __LINE__ );
+
+    return lld;
+}
+
+/*
+Returns LLD JSON with one {#MACRO} row per child of the monitoring node requested, or NULL
+if GlassFish could not be asked. Only the node itself is fetched, never the subtree below
+it. Within the cache ttl the previous result is returned as is; after that the node is asked
+with a conditional request, and the rows are rebuilt only if the body actually changed.
+*/
+char *discovery_get(struct fetchContext *ctx, const struct itemRequest *item, const char *macro)
+{
+    struct discoveryEntry *entry, local;
+    md5_state_t state;
+    md5_byte_t digest[MD5_DIGEST_SIZE];
+    char *data, *lld;
+    long status;
+
+    if (NULL == (entry = (struct discoveryEntry *)zbx_hashset_search(&discoveries, &item->key)))
+    {
+        memset(&local, 0, sizeof(local));
+        local.key = zbx_strdup(NULL, item->key);
+        entry = (struct discoveryEntry *)zbx_hashset_insert(&discoveries, &local, sizeof(local));
+    }
+
+    if (entry->lld != NULL && entry->checked + item->profile->cacheTtl > zbx_time())
+        return zbx_strdup(NULL, entry->lld);
+
+    data = fetch_data_conditional(ctx, item->fullURL, item->user, item->password, item->profile,
+                                  &entry->validators, &status);
+
+    if (data == NULL && status == 304 && entry->lld != NULL)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - discovery not modified: %s (%s:%d)",
+                   MODULE_NAME, item->fullURL, __FILE__, __LINE__ );
+        entry->checked = zbx_time();
+        entry->stale = 0;
+        return zbx_strdup(NULL, entry->lld);
+    }
+
+    if (data == NULL || status != 200)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - discovery failed with status %ld: %s (%s:%d)",
+                   MODULE_NAME, status, item->fullURL, __FILE__, __LINE__ );
+        zbx_free(data);
+
+        if (entry->lld == NULL)
+        {
+            zbx_free(entry->validators.etag);
+            zbx_free(entry->validators.lastModified);
+        }
+
+        /* the rows restored from the snapshot keep their items until GlassFish answers */
+        if (entry->lld != NULL && entry->stale != 0 && snapshot_usable(entry->stale) == SUCCEED)
+            return zbx_strdup(NULL, entry->lld);
+
+        return NULL;
+    }
+
+    zbx_md5_init(&state);
+    zbx_md5_append(&state, (const md5_byte_t *)data, strlen(data));
+    zbx_md5_finish(&state, digest);
+
+    if (entry->lld == NULL || memcmp(digest, entry->digest, sizeof(digest)) != 0)
+    {
+        if ((lld = discovery_build(data, macro)) == NULL)
+        {
+            zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not parse discovery: %s (%s:%d)",
+                       MODULE_NAME, item->fullURL, __FILE__, __LINE__ );
+            zbx_free(entry->validators.etag);
+            zbx_free(entry->validators.lastModified);
+            zbx_free(data);
+            return NULL;
+        }
+
+        zbx_free(entry->lld);
+        entry->lld = lld;
+        memcpy(entry->digest, digest, sizeof(digest));
+    }
+
+    entry->checked = zbx_time();
+    entry->stale = 0;
+    zbx_free(data);
+
+    return zbx_strdup(NULL, entry->lld);
+}
+
+/*
+Adds the discovery results to the snapshot, except those restored from it and not checked since.
+*/
+void discovery_snapshot_save(struct snapshotWriter *w)
+{
+    zbx_hashset_iter_t iter;
+    struct discoveryEntry *entry;
+
+    zbx_hashset_iter_reset(&discoveries, &iter);
+
+    while (NULL != (entry = (struct discoveryEntry *)zbx_hashset_iter_next(&iter)))
+    {
+        if (entry->lld == NULL || entry->stale != 0)
+            continue;
+
+        snapshot_record_begin(w, SNAPSHOT_DISCOVERY, entry->checked, entry->key);
+        snapshot_put_string(w, entry->lld);
+        snapshot_put_string(w, entry->validators.etag);
+        snapshot_put_string(w, entry->validators.lastModified);
+        snapshot_put(w, entry->digest, sizeof(entry->digest));
+        snapshot_record_end(w);
+    }
+}
+
+/*
+Restores a discovery result saved by discovery_snapshot_save(). It is checked again within
+one cache ttl. Returns FAIL if the record is damaged or the key is already known.
+*/
+int discovery_snapshot_load(double time, const char *key, struct snapshotReader *r)
+{
+    struct discoveryEntry local;
+    const char *lld, *etag, *lastModified;
+
+    lld = snapshot_get_string(r);
+    etag = snapshot_get_string(r);
+    lastModified = snapshot_get_string(r);
+
+    memset(&local, 0, sizeof(local));
+    snapshot_get(r, local.digest, sizeof(local.digest));
+
+    if (r->error != 0 || lld == NULL || zbx_hashset_search(&discoveries, &key) != NULL)
+        return FAIL;
+
+    local.key = zbx_strdup(NULL, key);
+    local.lld = zbx_strdup(NULL, lld);
+    local.validators.etag = (etag != NULL ? zbx_strdup(NULL, etag) : NULL);
+    local.validators.lastModified = (lastModified != NULL ? zbx_strdup(NULL, lastModified) : NULL);
+    local.checked = snapshot_refresh_time(key, glassfishConfig.defaults.cacheTtl) - glassfishConfig.defaults.cacheTtl;
+    local.stale = time;
+
+    zbx_hashset_insert(&discoveries, &local, sizeof(local));
+
+    return SUCCEED;
+}
@@ -0,0 +1,214 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include <curl/curl.h>
+#include "glassfish.h"
+
+/*
+Samples of one metric family. OpenMetrics does not allow the samples of a family to be
+interleaved with others, the same statistic shows up all over the tree, so every family
+collects its lines here while the response is scanned and they are written out at the end.
+*/
+struct exportFamily
+{
+    char *name;
+    const char *type;
+    int order;
+    char *samples;
+    size_t samplesAlloc;
+    size_t samplesOffset;
+};
+
+struct exportBuilder
+{
+    zbx_hashset_t families;
+    int count;
+};
+
+/*
+*/
+static void export_family_clean(void *data)
+{
+    struct exportFamily *family = (struct exportFamily *)data;
+
+    zbx_free(family->name);
+    zbx_free(family->samples);
+}
+
+/*
+Appends name with every character a metric name cannot hold replaced by '_'.
+*/
+static void export_name_append(char **name, size_t *alloc, size_t *offset, const char *part)
+{
+    for (; *part != '\0'; part++)
+        zbx_chrcpy_alloc(name, alloc, offset, isalnum((unsigned char)*part) ? *part : '_');
+}
+
+/*
+Fields of range statistics go up and down, the meaning of the others depends on the statistic:
+"count" is a counter for requestcount but a gauge for usedheapsize-count.
+*/
+static const char *export_type(const char *field)
+{
+    if (strcmp(field, "current") == 0 || strcmp(field, "lowwatermark") == 0 ||
+        strcmp(field, "highwatermark") == 0 || strcmp(field, "lowerbound") == 0 ||
+        strcmp(field, "upperbound") == 0)
+    {
+        return "gauge";
+    }
+
+    return "unknown";
+}
+
+/*
+Turns extraProperties.entity.<statistic>.<field> of every node into a sample of the family
+glassfish_<statistic>_<field>, labeled with the path of the node below the monitoring root.
+Strings and the starttime and lastsampletime of a statistic are left out.
+*/
+static int export_value(struct jsonScanner *js, const char *value, int isString, void *ctx)
+{
+    struct exportBuilder *builder = (struct exportBuilder *)ctx;
+    struct exportFamily *family, local;
+    char *name = NULL, *path = NULL;
+    size_t nameAlloc = 0, nameOffset = 0, pathAlloc = 0, pathOffset = 0;
+    const char *field, *p;
+    int i, entity = -1;
+
+    if (isString != 0 || (*value != '-' && !isdigit((unsigned char)*value)))
+        return 0;
+
+    for (i = 0; i < js->depth; i++)
+    {
+        if (strcmp(js->keys[i], "entity") == 0)
+        {
+            entity = i;
+            break;
+        }
+
+        if (strcmp(js->keys[i], "children") == 0 && i + 1 < js->depth)
+        {
+            if (pathOffset != 0)
+                zbx_chrcpy_alloc(&path, &pathAlloc, &pathOffset, '/');
+
+            zbx_strcpy_alloc(&path, &pathAlloc, &pathOffset, js->keys[++i]);
+        }
+    }
+
+    field = js->keys[js->depth - 1];
+
+    if (entity < 0 || js->depth - entity - 1 != 2 || strcmp(field, "starttime") == 0 ||
+        strcmp(field, "lastsampletime") == 0)
+    {
+        zbx_free(path);
+        return 0;
+    }
+
+    zbx_strcpy_alloc(&name, &nameAlloc, &nameOffset, "glassfish_");
+    export_name_append(&name, &nameAlloc, &nameOffset, js->keys[entity + 1]);
+    zbx_chrcpy_alloc(&name, &nameAlloc, &nameOffset, '_');
+    export_name_append(&name, &nameAlloc, &nameOffset, field);
+
+    local.name = name;
+
+    if (NULL == (family = (struct exportFamily *)zbx_hashset_search(&builder->families, &local)))
+    {
+        memset(&local, 0, sizeof(local));
+        local.name = name;
+        local.type = export_type(field);
+        local.order = builder->count++;
+        family = (struct exportFamily *)zbx_hashset_insert(&builder->families, &local, sizeof(local));
+    }
+    else
+        zbx_free(name);
+
+    zbx_strcpy_alloc(&family->samples, &family->samplesAlloc, &family->samplesOffset, family->name);
+
+    if (path != NULL)
+    {
+        zbx_strcpy_alloc(&family->samples, &family->samplesAlloc, &family->samplesOffset, "{path=\"");
+
+        for (p = path; *p != '\0'; p++)
+        {
+            if (*p == '"' || *p == '\\')
+                zbx_chrcpy_alloc(&family->samples, &family->samplesAlloc, &family->samplesOffset, '\\');
+
+            zbx_chrcpy_alloc(&family->samples, &family->samplesAlloc, &family->samplesOffset, *p);
+        }
+
+        zbx_strcpy_alloc(&family->samples, &family->samplesAlloc, &family->samplesOffset, "\"}");
+    }
+
+    zbx_snprintf_alloc(&family->samples, &family->samplesAlloc, &family->samplesOffset, " %s\n", value);
+    zbx_free(path);
+
+    return 0;
+}
+
+/*
+*/
+static int export_family_compare(const void *d1, const void *d2)
+{
+    const struct exportFamily *family1 = *(const struct exportFamily * const *)d1;
+    const struct exportFamily *family2 = *(const struct exportFamily * const *)d2;
+
+    return family1->order - family2->order;
+}
+
+/*
+Converts a monitoring response fetched with depth into OpenMetrics text, one family per
+statistic and field in the order they first appear, ending with "# EOF". The response is
+scanned once. Returns NULL if it is not valid JSON.
+*/
+char *export_openmetrics(const char *data)
+{
+    struct exportBuilder builder;
+    struct exportFamily **families, *family;
+    struct jsonScanner js;
+    zbx_hashset_iter_t iter;
+    char *out = NULL;
+    size_t outAlloc = 0, outOffset = 0;
+    double started = zbx_time();
+    int i;
+
+    zbx_hashset_create_ext(&builder.families, 256, STRING_PTR_HASH_FUNC, ZBX_DEFAULT_STRING_COMPARE_FUNC,
+                           export_family_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+                           ZBX_DEFAULT_MEM_FREE_FUNC);
+    builder.count = 0;
+
+    json_scan_init(&js, export_value, &builder);
+
+    if (json_scan(&js, data, strlen(data)) == JSON_SCAN_ERROR)
+    {
+        zbx_hashset_destroy(&builder.families);
+        return NULL;
+    }
+
+    families = (struct exportFamily **)zbx_malloc(NULL, sizeof(*families) * (builder.count + 1));
+
+    zbx_hashset_iter_reset(&builder.families, &iter);
+
+    for (i = 0; NULL != (family = (struct exportFamily *)zbx_hashset_iter_next(&iter)); i++)
+        families[i] = family;
+
+    qsort(families, builder.count, sizeof(*families), export_family_compare);
+
+    for (i = 0; i < builder.count; i++)
+    {
+        zbx_snprintf_alloc(&out, &outAlloc, &outOffset, "# TYPE %s %s\n", families[i]->name, families[i]->type);
+        zbx_strcpy_alloc(&out, &outAlloc, &outOffset, families[i]->samples);
+    }
+
+    zbx_strcpy_alloc(&out, &outAlloc, &outOffset, "# EOF\n");
+
+    zbx_free(families);
+    zbx_hashset_destroy(&builder.families);
+
+    stats_parse(zbx_time() - started);
+
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - exported %d metric families (%s:%d)",
+               MODULE_NAME, builder.count, __FILE__, __LINE__ );
+
+    return out;
+}
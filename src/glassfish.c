@@ -2,22 +2,152 @@
 #include "module.h"
 #include "common.h"
 #include "log.h"
+#include "zbxalgo.h"
 #include "pcreposix.h"
 #include "zbxregexp.h"
 #include "zbxjson.h"
 #include <curl/curl.h>
 #include <openssl/opensslv.h>
 #include <pcre.h>
+#include <pthread.h>
 #include "glassfish.h"
 
-CURL *curl;
+/*
+DNS entries and TLS sessions of the process, shared by the handles of all contexts; libcurl
+locks them through share_lock(). Connections are not shared, libcurl does not support that
+between threads: every context keeps its own, and they survive between item polls since the
+context does.
+*/
+struct curlPool
+{
+    CURLSH *share;
+    pid_t pid;
+    pthread_mutex_t lock;
+    pthread_mutex_t dataLocks[CURL_LOCK_DATA_LAST];
+};
+
+static struct curlPool pool = {NULL, 0, PTHREAD_MUTEX_INITIALIZER};
+
+/* built once, libcurl does not copy header lists */
+static struct curl_slist *acceptHeaders;
 
-struct memoryData
+struct regexEntry
 {
-    char *memory;
-    size_t size;
+    char *pattern;
+    pcre *re;
+    pcre_extra *extra;
+    zbx_uint64_t lastUsed;
 };
 
+/*
+*/
+static void fetch_error_set(struct fetchContext *ctx, const char *format, ...)
+{
+    va_list args;
+	
+    va_start(args, format);
+    vsnprintf(ctx->error, sizeof(ctx->error), format, args);
+    va_end(args);
+}
+
+/*
+Returns why a request of the current poll failed, or message if none did.
+*/
+const char *fetch_error(const struct fetchContext *ctx, const char *message)
+{
+    return (ctx->error[0] != '\0' ? ctx->error : message);
+}
+
+/*
+Prepares the buffer for a new transfer on handle, keeping the memory of the previous one.
+*/
+static void memory_reset(struct memoryData *mem, CURL *handle)
+{
+    mem->handle = handle;
+    mem->size = 0;
+	
+    if (mem->memory != NULL)
+        mem->memory[0] = '\0';
+}
+
+/*
+Makes room for at least needed bytes. The first chunk of a body sizes the buffer from
+Content-Length when the server sent one, later growth doubles the buffer, so a body costs
+a few reallocations instead of one per chunk.
+*/
+static int memory_reserve(struct memoryData *mem, size_t needed)
+{
+    size_t allocated = mem->allocated;
+    char *memory;
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t length = -1;
+	
+    if (mem->size == 0 && mem->handle != NULL)
+        curl_easy_getinfo(mem->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+#else
+    double length = -1;
+	
+    if (mem->size == 0 && mem->handle != NULL)
+        curl_easy_getinfo(mem->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &length);
+#endif
+	
+    if (length > 0 && (size_t)length + 1 > needed)
+        needed = (size_t)length + 1;
+	
+    if (allocated >= needed)
+        return SUCCEED;
+	
+    if (length > 0 && (size_t)length + 1 == needed)
+    {
+        allocated = needed;
+    }
+    else
+    {
+        if (allocated < RESPONSE_BUFFER_SIZE)
+            allocated = RESPONSE_BUFFER_SIZE;
+	
+        while (allocated < needed)
+            allocated *= 2;
+    }
+	
+    if ((memory = realloc(mem->memory, allocated)) == NULL)
+        return FAIL;
+	
+    mem->memory = memory;
+    mem->allocated = allocated;
+	
+    return SUCCEED;
+}
+
+/*
+Hands the body over to the caller without copying it. Only when the buffer is much larger
+than the body, after a bigger response on the same handle, the body is copied out and the
+buffer stays for the next transfer, so kept bodies do not pin oversized blocks.
+*/
+static char *memory_detach(struct memoryData *mem)
+{
+    char *data;
+	
+    if (mem->memory == NULL)
+        return zbx_strdup(NULL, "");
+	
+    if (mem->size + 1 < mem->allocated / 2)
+    {
+        data = (char *)zbx_malloc(NULL, mem->size + 1);
+        memcpy(data, mem->memory, mem->size + 1);
+    }
+    else
+    {
+        data = mem->memory;
+        mem->memory = NULL;
+        mem->allocated = 0;
+    }
+	
+    mem->size = 0;
+	
+    return data;
+}
+
 /*
 */
 size_t write_data_callback(void *contents, size_t size, size_t nmemb, void *userp)
@@ -25,12 +155,10 @@ size_t write_data_callback(void *contents, size_t size, size_t nmemb, void *user
     size_t realsize = size *nmemb;
     struct memoryData *mem = (struct memoryData *)userp;
 
-    mem->memory = realloc(mem->memory, mem->size + realsize + 1);
-
-    if(mem->memory == NULL)
+    if (mem->size + realsize + 1 > mem->allocated && memory_reserve(mem, mem->size + realsize + 1) != SUCCEED)
     {
         /* out of memory! */
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - not enough memory (realloc returned NULL)", 
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - not enough memory (realloc returned NULL) (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
         return 0;
     }
@@ -41,65 +169,276 @@ size_t write_data_callback(void *contents, size_t size, size_t nmemb, void *user
     return realsize;
 }
 
+/*
+Options common to every easy handle of the module. Bodies are asked for compressed with every
+encoding libcurl supports, and HTTP/2 is negotiated over TLS, so requests to one GlassFish or
+its proxy are multiplexed on one connection; plain HTTP stays HTTP/1.1 with keep-alive.
+*/
+void curl_handle_setup(CURL *handle)
+{
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPIDLE, (long)glassfishConfig.poolKeepaliveIdle);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPINTVL, (long)glassfishConfig.poolKeepaliveIdle);
+    curl_easy_setopt(handle, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+    curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, HTTP_ENCODING);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x074100
+    curl_easy_setopt(handle, CURLOPT_MAXAGE_CONN, (long)glassfishConfig.poolIdleTimeout);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x075000
+    curl_easy_setopt(handle, CURLOPT_MAXLIFETIME_CONN, (long)glassfishConfig.poolMaxLifetime);
+#endif
+}
+
+/*
+*/
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userp)
+{
+    ZBX_UNUSED(handle);
+    ZBX_UNUSED(access);
+    ZBX_UNUSED(userp);
+	
+    pthread_mutex_lock(&pool.dataLocks[data]);
+}
+
 /*
 */
+static void share_unlock(CURL *handle, curl_lock_data data, void *userp)
+{
+    ZBX_UNUSED(handle);
+    ZBX_UNUSED(userp);
+	
+    pthread_mutex_unlock(&pool.dataLocks[data]);
+}
+
+/*
+Returns the share handle of the current process, creating it on first use. The agent forks
+its collectors after zbx_module_init, a share handle inherited from another process is
+abandoned rather than cleaned up, as cleanup would shut down TLS sessions that still belong
+to the parent.
+*/
+static CURLSH *curl_share(void)
+{
+    CURLSH *share;
+    int i;
+	
+    pthread_mutex_lock(&pool.lock);
+	
+    if (pool.share != NULL && pool.pid == getpid())
+    {
+        share = pool.share;
+        pthread_mutex_unlock(&pool.lock);
+        return share;
+    }
+	
+    pool.share = NULL;
+	
+    if ((share = curl_share_init()) != NULL)
+    {
+        for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+            pthread_mutex_init(&pool.dataLocks[i], NULL);
+	
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, share_lock);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        pool.share = share;
+        pool.pid = getpid();
+    }
+	
+    pthread_mutex_unlock(&pool.lock);
+	
+    return share;
+}
+
+/*
+Called once from zbx_module_init, before any thread of the module runs.
+*/
 int curl_init(void)
 {
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if(curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+    {
+        return CURLE_FAILED_INIT;
+    }
+
+    if ((acceptHeaders = curl_slist_append(NULL, HTTP_ACCEPT)) == NULL)
+    {
+        return CURLE_OUT_OF_MEMORY;
+    }
+
+    return (curl_share() != NULL ? CURLE_OK : CURLE_FAILED_INIT);
+}
+
+/*
+Called once from zbx_module_uninit, after the contexts of the process are destroyed.
+*/
+void curl_uninit(void)
+{
+    if(pool.share != NULL && pool.pid == getpid())
+    {
+        curl_share_cleanup(pool.share);
+    }
+
+    pool.share = NULL;
+
+    curl_slist_free_all(acceptHeaders);
+    acceptHeaders = NULL;
 
-    curl = curl_easy_init();
+    curl_global_cleanup();
+}
+
+/*
+*/
+static void regex_entry_free(struct regexEntry *entry)
+{
+    if (entry->extra != NULL)
+        pcre_free_study(entry->extra);
+	
+    pcre_free(entry->re);
+    zbx_free(entry->pattern);
+    entry->extra = NULL;
+    entry->re = NULL;
+    entry->lastUsed = 0;
+}
 
-    if(curl)
+/*
+Creates the client state of one caller thread: an easy handle on the share handle of the
+process, a response buffer and a regex cache. Returns NULL if libcurl could not make a handle.
+*/
+struct fetchContext *fetch_context_create(void)
+{
+    struct fetchContext *ctx;
+    CURLSH *share;
+	
+    if ((share = curl_share()) == NULL)
+        return NULL;
+	
+    ctx = (struct fetchContext *)zbx_calloc(NULL, 1, sizeof(struct fetchContext));
+	
+    if ((ctx->handle = curl_easy_init()) == NULL)
     {
-        return CURLE_OK; /*0*/
+        zbx_free(ctx);
+        return NULL;
     }
-    return CURLE_FAILED_INIT; /*2*/
+	
+    curl_easy_setopt(ctx->handle, CURLOPT_SHARE, share);
+    curl_handle_setup(ctx->handle);
+	
+    ctx->regexes = (struct regexEntry *)zbx_calloc(NULL, REGEX_CACHE_SIZE, sizeof(struct regexEntry));
+    ctx->pid = getpid();
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - created libcurl handle for pid %d (%s:%d)", 
+               MODULE_NAME, (int)ctx->pid, __FILE__, __LINE__ );
+	
+    return ctx;
 }
 
 /*
+Frees ctx. The handle of a context inherited from another process is abandoned, like its
+share handle.
 */
-void curl_set_opt(const char *fullURL, const char *user, const char *password)
+void fetch_context_destroy(struct fetchContext *ctx)
 {
-    struct curl_slist *chunk = NULL;
+    int i;
+	
+    if (ctx == NULL)
+        return;
+	
+    if (ctx->pid == getpid())
+        curl_easy_cleanup(ctx->handle);
+	
+    for (i = 0; i < REGEX_CACHE_SIZE; i++)
+    {
+        if (ctx->regexes[i].pattern != NULL)
+            regex_entry_free(&ctx->regexes[i]);
+    }
+	
+    zbx_free(ctx->regexes);
+    zbx_free(ctx->buffer.memory);
+    zbx_free(ctx);
+}
 
-    chunk = curl_slist_append(chunk, HTTP_ACCEPT);
+/*
+Returns the context *owner holds for the current process, replacing one inherited through
+fork, or NULL if it could not be created. Every poll starts here, so the error of the
+previous poll is forgotten.
+*/
+struct fetchContext *fetch_context_acquire(struct fetchContext **owner)
+{
+    if (*owner != NULL && (*owner)->pid != getpid())
+    {
+        fetch_context_destroy(*owner);
+        *owner = NULL;
+    }
+	
+    if (*owner == NULL && (*owner = fetch_context_create()) == NULL)
+        return NULL;
+	
+    (*owner)->error[0] = '\0';
+	
+    return *owner;
+}
 
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, HTTP_USERAGENT);
+/*
+Sets the options of one request, TLS checks and deadlines come from the profile of its target.
+Nothing is allocated here, libcurl copies the strings and the header list is shared by all
+requests.
+*/
+void curl_set_opt_handle(CURL *handle, const char *fullURL, const char *user, const char *password,
+                         const struct targetProfile *profile)
+{
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, HTTP_USERAGENT);
 
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, acceptHeaders);
 
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, DEBUG);
+    curl_easy_setopt(handle, CURLOPT_VERBOSE, (long)glassfishConfig.debug);
 	
-    char auth[AUTH_LENGTH];
-    zbx_snprintf(auth, AUTH_LENGTH, "%s:%s", user, password);
+    curl_easy_setopt(handle, CURLOPT_USERNAME, user);
+
+    curl_easy_setopt(handle, CURLOPT_PASSWORD, password);
 
-    curl_easy_setopt(curl, CURLOPT_USERPWD, auth);
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, (long)profile->sslVerifyPeer);
 
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, SSL_VERIFYPEER);
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, (long)profile->sslVerifyHost);
 
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, SSL_VERIFYHOST);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, (long)profile->connectTimeout);
+
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, (long)profile->timeout);
 
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - fullURL: %s (%s:%d)", 
                MODULE_NAME, fullURL, __FILE__, __LINE__ );
 	
-    curl_easy_setopt(curl, CURLOPT_URL, fullURL);
+    curl_easy_setopt(handle, CURLOPT_URL, fullURL);
 }
 
 /*
+Returns the compiled and studied pattern, compiling it on first use, or NULL if it does not
+compile. The least recently used pattern is dropped when all REGEX_CACHE_SIZE slots are taken.
 */
-const char *parse_data(char *data, const char *regex)
+static struct regexEntry *regex_get(struct fetchContext *ctx, const char *regex)
 {
     const char *errorStr;
-    int errorOffset;
+    int errorOffset, i, studyOptions = 0;
+    struct regexEntry *entry = NULL;
     pcre *re;
-    int pcreExecRet;
-    char **aLineToMatch;
-    int subStrVec[30];
-    const char *psubStrMatchStr;
-    char *dataTmp[] = {data, NULL};
 	
-    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - regex: '%s' (%s:%d)", 
-               MODULE_NAME, regex, __FILE__, __LINE__ );
+    for (i = 0; i < REGEX_CACHE_SIZE; i++)
+    {
+        if (ctx->regexes[i].pattern != NULL && strcmp(ctx->regexes[i].pattern, regex) == 0)
+        {
+            ctx->regexes[i].lastUsed = ++ctx->regexClock;
+            return &ctx->regexes[i];
+        }
+	
+        if (entry == NULL || ctx->regexes[i].lastUsed < entry->lastUsed)
+            entry = &ctx->regexes[i];
+    }
 	
     re = pcre_compile(regex, 
                       PCRE_MULTILINE,
@@ -110,51 +449,625 @@ const char *parse_data(char *data, const char *regex)
     {
         zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not compile regex: '%s' because %s (%s:%d)", 
                    MODULE_NAME, regex, errorStr, __FILE__, __LINE__ );
-        exit(-1);
+        fetch_error_set(ctx, "Invalid regex '%s': %s", regex, errorStr);
+        return NULL;
+    }
+	
+    if (entry->pattern != NULL)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - regex cache full, dropping '%s' (%s:%d)", 
+                   MODULE_NAME, entry->pattern, __FILE__, __LINE__ );
+        regex_entry_free(entry);
     }
 	
+#ifdef PCRE_STUDY_JIT_COMPILE
+    studyOptions = PCRE_STUDY_JIT_COMPILE;
+#endif
+    entry->re = re;
+    entry->extra = pcre_study(re, studyOptions, &errorStr);
+    entry->pattern = zbx_strdup(NULL, regex);
+    entry->lastUsed = ++ctx->regexClock;
+	
+    return entry;
+}
+
+/*
+Returns a copy of the first capture group, or NULL if the regex did not match or is invalid.
+*/
+char *parse_data(struct fetchContext *ctx, char *data, const char *regex)
+{
+    struct regexEntry *entry;
+    int pcreExecRet;
+    char **aLineToMatch;
+    int subStrVec[30];
+    const char *psubStrMatchStr = NULL;
+    char *dataTmp[] = {data, NULL};
+    char *dataRes = NULL;
+    double started;
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - regex: '%s' (%s:%d)", 
+               MODULE_NAME, regex, __FILE__, __LINE__ );
+	
+    started = zbx_time();
+	
+    if ((entry = regex_get(ctx, regex)) == NULL)
+        return NULL;
+	
     for(aLineToMatch = dataTmp; *aLineToMatch != NULL; aLineToMatch++)
     {
-        pcreExecRet = pcre_exec(re,
-                                NULL,
+        pcreExecRet = pcre_exec(entry->re,
+                                entry->extra,
                                 *aLineToMatch,
                                 strlen(*aLineToMatch),
                                 0,
                                 0,
                                 subStrVec,
                                 30);
+	
+        if (pcreExecRet > REGEX_GROUP &&
+            pcre_get_substring(*aLineToMatch, subStrVec, pcreExecRet, REGEX_GROUP, &(psubStrMatchStr)) >= 0)
+        {
+            dataRes = zbx_strdup(dataRes, psubStrMatchStr);
+            pcre_free_substring(psubStrMatchStr);
+        }
+    }
+	
+    stats_parse(zbx_time() - started);
+	
+    return dataRes;
+}
+
+/*
+A bare statistic field such as "count" or "current" selects bulk mode, anything else is a regex.
+*/
+int is_field_name(const char *pattern)
+{
+    const char *p;
+	
+    if (*pattern == '\0')
+        return 0;
+	
+    for (p = pattern; *p != '\0'; p++)
+    {
+        if (!isalnum((unsigned char)*p) && *p != '_' && *p != '-')
+            return 0;
+    }
+	
+    return 1;
+}
 
-	pcre_get_substring(*aLineToMatch, subStrVec, pcreExecRet, REGEX_GROUP, &(psubStrMatchStr));
+/*
+Performs the transfer set up on the handle of ctx unless the breaker of the GlassFish is open. A transfer
+error or a 5xx status counts as a failure of the GlassFish and returns FAIL, the body of such
+a response is not used. decoded points to the count of body bytes the write callback received.
+*/
+static int fetch_perform(struct fetchContext *ctx, const char *fullURL, long *status, const size_t *decoded)
+{
+    CURLcode res;
+	
+    *status = 0;
+	
+    if (breaker_allow(fullURL) != SUCCEED)
+    {
+        fetch_error_set(ctx, "GlassFish keeps failing, not asked until its backoff ends: %s", fullURL);
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - breaker open: %s (%s:%d)", 
+                   MODULE_NAME, fullURL, __FILE__, __LINE__ );
+        return FAIL;
+    }
+	
+    res = curl_easy_perform(ctx->handle);
+	
+    stats_transfer(ctx->handle, 0, *decoded);
+	
+    if (res == CURLE_OK)
+        curl_easy_getinfo(ctx->handle, CURLINFO_RESPONSE_CODE, status);
+	
+    breaker_report(fullURL, res == CURLE_OK && *status < 500);
+	
+    if (res != CURLE_OK)
+    {
+        fetch_error_set(ctx, "Request failed: %s: %s", curl_easy_strerror(res), fullURL);
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - curl_easy_perform failed: %s (%s:%d)", 
+                   MODULE_NAME, curl_easy_strerror(res), __FILE__, __LINE__ );
+        return FAIL;
+    }
+	
+    if (*status >= 500)
+    {
+        fetch_error_set(ctx, "GlassFish answered with status %ld: %s", *status, fullURL);
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - status %ld: %s (%s:%d)", 
+                   MODULE_NAME, *status, fullURL, __FILE__, __LINE__ );
+        return FAIL;
     }
+	
+    return SUCCEED;
+}
+
+/*
+Performs the request, bypassing the response cache. Returns NULL if the transfer failed. The
+body is received into the buffer of ctx, which is reused between requests.
+*/
+char *fetch_data(struct fetchContext *ctx, const char *fullURL, const char *user, const char *password,
+                 const struct targetProfile *profile)
+{
+    long status;
+	
+    memory_reset(&ctx->buffer, ctx->handle);
+	
+    curl_set_opt_handle(ctx->handle, fullURL, user, password, profile);
+	
+    curl_easy_setopt(ctx->handle, CURLOPT_WRITEFUNCTION, write_data_callback);
+	
+    curl_easy_setopt(ctx->handle, CURLOPT_WRITEDATA, (void *)&ctx->buffer);
+	
+    /*get it*/
+    if (fetch_perform(ctx, fullURL, &status, &ctx->buffer.size) != SUCCEED)
+        return NULL;
+	
+    return memory_detach(&ctx->buffer);
+}
+
+/*
+Keeps the ETag and Last-Modified response headers for the next conditional request.
+*/
+static size_t header_validators_callback(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    size_t realsize = size * nitems, nameLength, valueLength;
+    struct fetchValidators *validators = (struct fetchValidators *)userp;
+    char **target;
+	
+    if (realsize > 5 && strncasecmp(buffer, "ETag:", 5) == 0)
+    {
+        target = &validators->etag;
+        nameLength = 5;
+    }
+    else if (realsize > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0)
+    {
+        target = &validators->lastModified;
+        nameLength = 14;
+    }
+    else
+        return realsize;
+	
+    while (nameLength < realsize && buffer[nameLength] == ' ')
+        nameLength++;
+	
+    for (valueLength = realsize - nameLength; valueLength > 0; valueLength--)
+    {
+        if (buffer[nameLength + valueLength - 1] != '\r' && buffer[nameLength + valueLength - 1] != '\n')
+            break;
+    }
+	
+    zbx_free(*target);
+    *target = (char *)zbx_malloc(NULL, valueLength + 1);
+    memcpy(*target, buffer + nameLength, valueLength);
+    (*target)[valueLength] = '\0';
+	
+    return realsize;
+}
 
-    pcre_free(re);
-    return psubStrMatchStr;
+/*
+Builds the request headers, with If-None-Match and If-Modified-Since if validators has any.
+*/
+static struct curl_slist *conditional_headers(const struct fetchValidators *validators)
+{
+    struct curl_slist *headers = NULL;
+    char *header;
+	
+    headers = curl_slist_append(headers, HTTP_ACCEPT);
+	
+    if (validators->etag != NULL)
+    {
+        header = zbx_dsprintf(NULL, "If-None-Match: %s", validators->etag);
+        headers = curl_slist_append(headers, header);
+        zbx_free(header);
+    }
+	
+    if (validators->lastModified != NULL)
+    {
+        header = zbx_dsprintf(NULL, "If-Modified-Since: %s", validators->lastModified);
+        headers = curl_slist_append(headers, header);
+        zbx_free(header);
+    }
+	
+    return headers;
 }
 
 /*
+Performs the request with If-None-Match and If-Modified-Since taken from validators, which
+are replaced by the validators of the response. Returns NULL if the transfer failed or the
+resource did not change, *status tells the two apart.
 */
-char *get_data()
+char *fetch_data_conditional(struct fetchContext *ctx, const char *fullURL, const char *user, const char *password,
+                             const struct targetProfile *profile, struct fetchValidators *validators, long *status)
 {
     int res;
-    struct memoryData chunk;
-    chunk.memory = malloc(1);
-    chunk.size = 0;
+    struct curl_slist *headers;
 	
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data_callback);
+    memory_reset(&ctx->buffer, ctx->handle);
 	
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+    curl_set_opt_handle(ctx->handle, fullURL, user, password, profile);
 	
-    /*get it*/
-    res = curl_easy_perform(curl);
+    headers = conditional_headers(validators);
+	
+    curl_easy_setopt(ctx->handle, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(ctx->handle, CURLOPT_HEADERFUNCTION, header_validators_callback);
+    curl_easy_setopt(ctx->handle, CURLOPT_HEADERDATA, (void *)validators);
+    curl_easy_setopt(ctx->handle, CURLOPT_WRITEFUNCTION, write_data_callback);
+    curl_easy_setopt(ctx->handle, CURLOPT_WRITEDATA, (void *)&ctx->buffer);
+	
+    res = fetch_perform(ctx, fullURL, status, &ctx->buffer.size);
+	
+    curl_easy_setopt(ctx->handle, CURLOPT_HTTPHEADER, NULL);
+    curl_easy_setopt(ctx->handle, CURLOPT_HEADERFUNCTION, NULL);
+    curl_easy_setopt(ctx->handle, CURLOPT_HEADERDATA, NULL);
+    curl_slist_free_all(headers);
+	
+    if (res != SUCCEED || *status == 304)
+        return NULL;
+	
+    return memory_detach(&ctx->buffer);
+}
+
+/*
+Joins the flight of the request in shared memory. Returns SHM_HIT with the body another
+agent process fetched within the cache ttl of the profile, waiting for it up to the request
+deadline if the fetch is still going, SHM_FAILED with the error set if that fetch failed or
+did not finish in time, or SHM_CLAIMED if the caller fetches and publishes the body.
+*/
+static int fetch_flight(struct fetchContext *ctx, const char *key, const char *fullURL,
+                        const struct targetProfile *profile, char **data, int *slot)
+{
+    double deadline = zbx_time() + profile->timeout;
+    int ret;
 	
-    if(res != CURLE_OK)
+    if ((ret = shm_lookup(key, profile->cacheTtl, data, slot)) == SHM_BUSY)
+        ret = shm_wait(key, profile->cacheTtl, deadline, data, slot);
+	
+    switch (ret)
     {
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - curl_easy_perform failed (%s:%d)", 
-                   MODULE_NAME, curl_easy_strerror(res), __FILE__, __LINE__ );
-        exit(-1);
+        case SHM_HIT:
+            zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - shared hit: %s (%s:%d)", 
+                       MODULE_NAME, fullURL, __FILE__, __LINE__ );
+            break;
+        case SHM_FAILED:
+            fetch_error_set(ctx, "Request failed in another agent process: %s", fullURL);
+            break;
+        case SHM_BUSY:
+            fetch_error_set(ctx, "Request timed out waiting for another agent process: %s", fullURL);
+            ret = SHM_FAILED;
+            break;
     }
 	
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
-    return chunk.memory;
+    return ret;
+}
+
+/*
+Fetches the request unless another agent process fetched it within the cache ttl of the
+profile, in which case its body is taken from shared memory, or is fetching it right now, in
+which case it is waited for. key is the cache key of the request. Returns NULL if the transfer
+failed.
+*/
+char *fetch_shared(struct fetchContext *ctx, const char *key, const char *fullURL, const char *user, const char *password,
+                   const struct targetProfile *profile)
+{
+    char *data;
+    int slot;
+	
+    switch (fetch_flight(ctx, key, fullURL, profile, &data, &slot))
+    {
+        case SHM_HIT:
+            return data;
+        case SHM_FAILED:
+            return NULL;
+    }
+	
+    if ((data = fetch_data(ctx, fullURL, user, password, profile)) == NULL)
+    {
+        shm_fail(slot);
+        return NULL;
+    }
+	
+    shm_store(slot, key, data);
+	
+    return data;
+}
+
+/*
+fetch_shared() for a body the caller already has: the request is conditional, and current,
+the body it has, is what the flight publishes if GlassFish answers 304. A body taken from
+shared memory comes with status 200 whether it changed or not. Returns NULL if the transfer
+failed or the resource did not change, *status tells the two apart.
+*/
+char *fetch_shared_conditional(struct fetchContext *ctx, const char *key, const char *fullURL, const char *user,
+                               const char *password, const struct targetProfile *profile,
+                               struct fetchValidators *validators, const char *current, long *status)
+{
+    char *data;
+    int slot;
+	
+    *status = 0;
+	
+    switch (fetch_flight(ctx, key, fullURL, profile, &data, &slot))
+    {
+        case SHM_HIT:
+            *status = 200;
+            return data;
+        case SHM_FAILED:
+            return NULL;
+    }
+	
+    data = fetch_data_conditional(ctx, fullURL, user, password, profile, validators, status);
+	
+    if (data != NULL)
+        shm_store(slot, key, data);
+    else if (*status == 304)
+        shm_store(slot, key, current);
+    else
+        shm_fail(slot);
+	
+    return data;
+}
+
+/*
+Creates a multi handle for fetch_multi(). Connections stay in its cache between calls.
+*/
+CURLM *fetch_multi_init(void)
+{
+    CURLM *multi;
+	
+    if ((multi = curl_multi_init()) == NULL)
+        return NULL;
+	
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)glassfishConfig.multiHostConnections);
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)glassfishConfig.multiMaxConnections);
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)glassfishConfig.multiMaxConnections);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+	
+    return multi;
+}
+
+/*
+Runs all requests concurrently on the multi handle, at most multi_host_connections per host,
+and waits on their sockets with curl_multi_wait(). The easy handles use the share handle of
+the process, so DNS entries and TLS sessions carry over between rounds and from the item
+handlers, while connections stay in the cache of the multi handle. Transfers still running
+at the deadline are abandoned. Requests with validators are conditional, requests to a GlassFish whose
+breaker is open are not made. On return requests[i].data holds the body, or NULL if the
+request failed, GlassFish answered with a status of 500 or above or, with status 304, the
+resource did not change.
+*/
+void fetch_multi(CURLM *multi, struct fetchRequest *requests, int count, double deadline)
+{
+    struct memoryData *chunks;
+    struct curl_slist **headers;
+    CURL **handles;
+    char *done;
+    CURLMsg *msg;
+    CURLSH *share;
+    int i, running, numfds, queued;
+    double now;
+	
+    share = curl_share();
+	
+    handles = (CURL **)zbx_calloc(NULL, count, sizeof(CURL *));
+    chunks = (struct memoryData *)zbx_calloc(NULL, count, sizeof(struct memoryData));
+    headers = (struct curl_slist **)zbx_calloc(NULL, count, sizeof(struct curl_slist *));
+    done = (char *)zbx_calloc(NULL, count, sizeof(char));
+	
+    for (i = 0; i < count; i++)
+    {
+        requests[i].data = NULL;
+        requests[i].status = 0;
+	
+        if (breaker_allow(requests[i].fullURL) != SUCCEED)
+            continue;
+	
+        if ((handles[i] = curl_easy_init()) == NULL)
+            continue;
+	
+        memory_reset(&chunks[i], handles[i]);
+	
+        if (share != NULL)
+            curl_easy_setopt(handles[i], CURLOPT_SHARE, share);
+	
+        curl_handle_setup(handles[i]);
+        curl_set_opt_handle(handles[i], requests[i].fullURL, requests[i].user, requests[i].password,
+                            requests[i].profile);
+        curl_easy_setopt(handles[i], CURLOPT_WRITEFUNCTION, write_data_callback);
+        curl_easy_setopt(handles[i], CURLOPT_WRITEDATA, (void *)&chunks[i]);
+        curl_easy_setopt(handles[i], CURLOPT_PRIVATE, (void *)&chunks[i]);
+	
+        if (requests[i].validators != NULL)
+        {
+            headers[i] = conditional_headers(requests[i].validators);
+            curl_easy_setopt(handles[i], CURLOPT_HTTPHEADER, headers[i]);
+            curl_easy_setopt(handles[i], CURLOPT_HEADERFUNCTION, header_validators_callback);
+            curl_easy_setopt(handles[i], CURLOPT_HEADERDATA, (void *)requests[i].validators);
+        }
+	
+        curl_multi_add_handle(multi, handles[i]);
+    }
+	
+    do
+    {
+        curl_multi_perform(multi, &running);
+	
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL)
+        {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+	
+            for (i = 0; i < count && handles[i] != msg->easy_handle; i++)
+                ;
+	
+            if (i == count)
+                continue;
+	
+            done[i] = 1;
+            stats_transfer(msg->easy_handle, 1, chunks[i].size);
+	
+            if (msg->data.result == CURLE_OK)
+            {
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &requests[i].status);
+                breaker_report(requests[i].fullURL, requests[i].status < 500);
+	
+                /* an error page is not a body, the chunk is freed below */
+                if (requests[i].status >= 500)
+                {
+                    zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - status %ld: %s (%s:%d)", 
+                               MODULE_NAME, requests[i].status, requests[i].fullURL, __FILE__, __LINE__ );
+                }
+                else if (requests[i].status != 304)
+                    requests[i].data = memory_detach(&chunks[i]);
+            }
+            else
+            {
+                breaker_report(requests[i].fullURL, 0);
+                stats_error();
+                zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - transfer of %s failed: %s (%s:%d)", 
+                           MODULE_NAME, requests[i].fullURL, curl_easy_strerror(msg->data.result),
+                           __FILE__, __LINE__ );
+            }
+        }
+	
+        if (running == 0)
+            break;
+	
+        if ((now = zbx_time()) >= deadline)
+        {
+            zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - %d transfers did not finish before the deadline (%s:%d)", 
+                       MODULE_NAME, running, __FILE__, __LINE__ );
+            break;
+        }
+	
+        curl_multi_wait(multi, NULL, 0, (int)((deadline - now) * 1000) + 1, &numfds);
+    }
+    while (1);
+	
+    for (i = 0; i < count; i++)
+    {
+        if (handles[i] == NULL)
+            continue;
+	
+        /* abandoned at the deadline, a finished transfer was reported when it completed */
+        if (done[i] == 0)
+            breaker_report(requests[i].fullURL, 0);
+	
+        curl_multi_remove_handle(multi, handles[i]);
+        curl_easy_cleanup(handles[i]);
+        curl_slist_free_all(headers[i]);
+        zbx_free(chunks[i].memory);
+    }
+	
+    zbx_free(done);
+    zbx_free(headers);
+    zbx_free(handles);
+    zbx_free(chunks);
+}
+
+/*
+Returns the response body for the request, either from the response cache or from GlassFish.
+*/
+char *get_data(struct fetchContext *ctx, const struct itemRequest *item)
+{
+    return get_data_version(ctx, item, NULL);
+}
+
+/*
+Same as get_data(), *version is set to a number that changes only when the body does. Returns
+NULL if GlassFish could not be asked, fetch_error() tells why.
+*/
+char *get_data_version(struct fetchContext *ctx, const struct itemRequest *item, zbx_uint64_t *version)
+{
+    char *data;
+	
+    if ((data = collector_get(item, version)) != NULL)
+        return data;
+	
+    if ((data = cache_get(item->key, version)) != NULL)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - cache hit: %s (%s:%d)", 
+                   MODULE_NAME, item->fullURL, __FILE__, __LINE__ );
+        return data;
+    }
+	
+    return cache_refresh(ctx, item, version);
+}
+
+/*
+Returns the value pattern selects in a body of the request, a JSON path or a regex. The
+value is kept with the version of the body it was parsed from, so as long as the body does
+not change it is not parsed again.
+*/
+static char *get_body_value(struct fetchContext *ctx, const struct itemRequest *item, const char *data,
+                            zbx_uint64_t version, const char *pattern)
+{
+    char *value;
+	
+    if (cache_value_get(item->key, pattern, version, &value) == SUCCEED)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - body did not change, reusing value: %s (%s:%d)", 
+                   MODULE_NAME, item->fullURL, __FILE__, __LINE__ );
+        return value;
+    }
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - raw data: %s (%s:%d)", 
+               MODULE_NAME, data, __FILE__, __LINE__ );
+	
+    if (is_json_path(pattern))
+        value = json_path_get(data, pattern);
+    else
+        value = parse_data(ctx, (char *)data, pattern);
+	
+    /* an invalid regex is not remembered, its error is reported on every poll */
+    if (value != NULL || ctx->error[0] == '\0')
+        cache_value_put(item->key, pattern, version, value);
+	
+    return value;
+}
+
+/*
+Returns the value the pattern of the request selects in the response. A JSON path is looked
+up in the same shared body a regex is, so it goes through the caches, single-flight and
+conditional revalidation like any other item.
+*/
+char *get_value(struct fetchContext *ctx, const struct itemRequest *item)
+{
+    char *data, *value;
+    zbx_uint64_t version;
+	
+    if ((data = get_data_version(ctx, item, &version)) == NULL)
+        return NULL;
+	
+    value = get_body_value(ctx, item, data, version, item->pattern);
+	
+    zbx_free(data);
+	
+    return value;
+}
+
+/*
+Returns another value of the response the request was just answered from: pattern is an
+index key for a bulk request and a JSON path or a regex otherwise. Nothing is fetched, NULL
+is returned if the response is not at hand.
+*/
+char *get_field(struct fetchContext *ctx, const struct itemRequest *item, const char *pattern)
+{
+    char *data, *value;
+    zbx_uint64_t version;
+	
+    if (item->indexKey != NULL)
+        return bulk_get(ctx, item, pattern);
+	
+    if (NULL == (data = collector_get(item, &version)) && NULL == (data = cache_get(item->key, &version)))
+        return NULL;
+	
+    value = get_body_value(ctx, item, data, version, pattern);
+	
+    zbx_free(data);
+	
+    return value;
 }
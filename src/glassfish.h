@@ -1,20 +1,454 @@
 #define MODULE_NAME     "glassfish.so"
 #define HTTP_ACCEPT     "Accept: application/json"
 #define HTTP_USERAGENT  "zabbix-agent"
+#define HTTP_ENCODING   ""
 #define SSL_VERIFYPEER  0
 #define SSL_VERIFYHOST  0
-#define URL_LENGTH      200
-#define AUTH_LENGTH     100
 #define REGEX_GROUP     1
 #define DEBUG           0
 
+/* most values below are only defaults, glassfish.conf sets them at runtime */
+#define GLASSFISH_CONF_FILE     "/etc/zabbix/glassfish.conf"
+#define CONFIG_LINE_LENGTH      1024
+
+/* lifetime of pooled connections, in seconds; defaults of pool_* in glassfish.conf */
+#define POOL_IDLE_TIMEOUT       120
+#define POOL_MAX_LIFETIME       3600
+#define POOL_KEEPALIVE_IDLE     60
+
+/* deadlines of one request, in seconds; a request that hits one fails instead of stalling the poll */
+#define HTTP_CONNECT_TIMEOUT    5
+#define HTTP_TIMEOUT            15
+#define HTTP_ERROR_LENGTH       256
+
+/* a GlassFish failing BREAKER_FAILURES times in a row is not asked for BREAKER_BACKOFF seconds,
+   doubling up to BREAKER_MAX_BACKOFF while it keeps failing */
+#define BREAKER_FAILURES        3
+#define BREAKER_BACKOFF         10
+#define BREAKER_MAX_BACKOFF     300
+#define BREAKER_ENDPOINT_LENGTH 256
+
+/* responses are shared between items for about one polling interval, in seconds */
+#define CACHE_TTL               30
+#define CACHE_MAX_ENTRIES       1024
+
+/* bodies that did not change are refreshed less and less often, up to these limits */
+#define CACHE_MAX_TTL           (8 * CACHE_TTL)
+
+/* background collector, COLLECTOR_INTERVAL 0 disables it */
+#define COLLECTOR_INTERVAL      30
+#define COLLECTOR_IDLE_TIMEOUT  600
+#define COLLECTOR_DEADLINE      20
+#define COLLECTOR_MAX_AGE       (3 * glassfishConfig.collectorInterval)
+#define COLLECTOR_MAX_INTERVAL  (8 * glassfishConfig.collectorInterval)
+
+/* responses shared between agent processes, SHM_WAIT_STEP in milliseconds */
+#define SHM_SLOTS               64
+#define SHM_SLOT_SIZE           262144
+#define SHM_KEY_LENGTH          512
+#define SHM_PROBES              8
+#define SHM_READ_RETRIES        100
+#define SHM_CLAIM_TIMEOUT       60
+#define SHM_WAIT_STEP           10
+
+#define SHM_HIT                 0
+#define SHM_CLAIMED             1
+#define SHM_BUSY                2
+#define SHM_FAILED              3
+
+/* concurrency of the curl_multi fetch engine */
+#define MULTI_HOST_CONNECTIONS  4
+#define MULTI_MAX_CONNECTIONS   32
+
+/* initial size of a response buffer without Content-Length, it doubles as needed */
+#define RESPONSE_BUFFER_SIZE    16384
+
+/* last-known state written to disk every SNAPSHOT_INTERVAL seconds for a warm start, 0 disables it */
+#define SNAPSHOT_FILE           "/var/lib/zabbix/glassfish.snapshot"
+#define SNAPSHOT_INTERVAL       300
+#define SNAPSHOT_MAX_AGE        3600
+#define SNAPSHOT_MAGIC          "GFSNAP\0\0"
+#define SNAPSHOT_VERSION        2
+#define SNAPSHOT_ORDER          0x01020304
+
+#define SNAPSHOT_BODY           1
+#define SNAPSHOT_INDEX          2
+#define SNAPSHOT_DISCOVERY      3
+#define SNAPSHOT_COUNTER        4
+
+/* latency histograms, per item key and process */
+#define STATS_MAX_KEYS          32
+#define STATS_SUB_BUCKETS       8
+#define STATS_BUCKET_GROUPS     28
+
+/* requests built from item key parameters, kept per process */
+#define REQUEST_MAX_ENTRIES     4096
+
+/* samples kept per counter item for rate and delta keys */
+#define RATE_SAMPLES            4
+
+#define COUNTER_VALUE           0
+#define COUNTER_RATE            1
+#define COUNTER_DELTA           2
+
+/* nodes glassfish.application.rollup sums up, ROLLUP_TOP is the default n of "top" */
+#define ROLLUP_APPLICATION      0
+#define ROLLUP_SERVLET          1
+#define ROLLUP_TOP              10
+
+/* compiled patterns kept per process */
+#define REGEX_CACHE_SIZE        32
+
+/* bulk mode fetches a whole monitoring subtree once and answers items from an index */
+#define BULK_DEPTH              5
+#define BULK_KEY_LENGTH         512
+
+/* glassfish.export.openmetrics fetches the whole monitoring tree down to this depth */
+#define EXPORT_DEPTH            7
+
+#define JSON_MAX_DEPTH          32
+#define JSON_KEY_LENGTH         128
+#define JSON_VALUE_LENGTH       256
+
+#define JSON_SCAN_MORE          0
+#define JSON_SCAN_DONE          1
+#define JSON_SCAN_ERROR         2
+
+#define STRING_PTR_HASH_FUNC    string_ptr_hash_func
+
 #define GLASSFISH_PING_CONNECTION_POOL  "management/domain/resources/ping-connection-pool"
 #define GLASSFISH_RESOURCE              "monitoring/domain/server/resources"
 #define GLASSFISH_HTTP_SERVICE          "monitoring/domain/server/http-service/server/request"
 #define GLASSFISH_APPLICATION           "monitoring/domain/server/applications"
+#define GLASSFISH_MONITORING            "monitoring/domain/server"
+
+/*
+Where and how to reach one GlassFish, a [name] section of glassfish.conf. url is the scheme
+and host, as the first parameter of a long item key.
+*/
+struct targetProfile
+{
+    char *name;
+    char *url;
+    char *port;
+    char *user;
+    char *password;
+    int sslVerifyPeer;
+    int sslVerifyHost;
+    int connectTimeout;
+    int timeout;
+    int cacheTtl;
+};
+
+/* runtime tunables, loaded once by zbx_module_init; defaults applies to long item keys */
+struct moduleConfig
+{
+    struct targetProfile defaults;
+    struct targetProfile *profiles;
+    int profileCount;
+    int poolIdleTimeout;
+    int poolMaxLifetime;
+    int poolKeepaliveIdle;
+    int cacheMaxTtl;
+    int collectorInterval;
+    int collectorIdleTimeout;
+    int collectorDeadline;
+    int multiHostConnections;
+    int multiMaxConnections;
+    int breakerFailures;
+    int breakerBackoff;
+    int breakerMaxBackoff;
+    char *snapshotFile;
+    int snapshotInterval;
+    int snapshotMaxAge;
+    int debug;
+};
+
+extern struct moduleConfig glassfishConfig;
+
+/* a monitoring subtree glassfish.stat can read, see subtree.c */
+struct monitoringSubtree
+{
+    const char *name;
+    int depth;
+};
+
+struct rateSample
+{
+    double clock;
+    double value;
+};
+
+/*
+Recent samples of a cumulative counter. startPattern and samplePattern select the starttime
+and lastsampletime of the statistic the counter belongs to, GlassFish resets both on restart.
+*/
+struct rateState
+{
+    char *startPattern;
+    char *samplePattern;
+    zbx_uint64_t startTime;
+    zbx_uint64_t lastSampleTime;
+    int count;
+    int next;
+    struct rateSample samples[RATE_SAMPLES];
+};
+
+/*
+Request built from the parameters of one item key on its first poll. key is the cache key
+of fullURL; indexKey is set for items answered from a bulk index, fullURL is the subtree then.
+*/
+struct itemRequest
+{
+    char *name;
+    int nparam;
+    char **params;
+    char *fullURL;
+    char *key;
+    char *user;
+    char *password;
+    char *pattern;
+    char *indexKey;
+    const struct targetProfile *profile;
+    struct rateState *rate;
+    double used;
+};
+
+/* per application total of a rollup */
+struct rollupApplication
+{
+    char *name;
+    double value;
+};
+
+/*
+One statistic summed up over all applications or all servlets of an applications bulk index.
+suffix is ".<statistic>.<field>", applications holds the total of every application.
+*/
+struct bulkRollup
+{
+    char *key;
+    char *suffix;
+    int scope;
+    double sum;
+    double min;
+    double max;
+    int count;
+    zbx_hashset_t applications;
+};
+
+struct cacheStats
+{
+    zbx_uint64_t hits;
+    zbx_uint64_t misses;
+    zbx_uint64_t evictions;
+    zbx_uint64_t entries;
+    zbx_uint64_t unchanged;
+    zbx_uint64_t reused;
+    zbx_uint64_t restored;
+    zbx_uint64_t stale;
+};
+
+struct jsonScanner;
+
+typedef int (*json_value_cb)(struct jsonScanner *js, const char *value, int isString, void *ctx);
+
+struct jsonScanner
+{
+    int state;
+    int depth;
+    int escape;
+    int result;
+    unsigned int unicode;
+    char type[JSON_MAX_DEPTH];
+    int index[JSON_MAX_DEPTH];
+    char keys[JSON_MAX_DEPTH][JSON_KEY_LENGTH];
+    char token[JSON_VALUE_LENGTH];
+    size_t tokenLength;
+    json_value_cb onValue;
+    void *ctx;
+};
+
+struct jsonPathMatch
+{
+    const char *path;
+    char value[JSON_VALUE_LENGTH];
+    int found;
+};
+
+struct fetchValidators
+{
+    char *etag;
+    char *lastModified;
+};
+
+/* response buffer of one easy handle, reused between its transfers */
+struct memoryData
+{
+    CURL *handle;
+    char *memory;
+    size_t size;
+    size_t allocated;
+};
+
+struct regexEntry;
+
+/*
+Client state of one thread making requests: its easy handle and response buffer, its compiled
+patterns and why its last request failed. Nothing in it is shared, every thread owns its own
+context and passes it to the fetch and get functions.
+*/
+struct fetchContext
+{
+    CURL *handle;
+    struct memoryData buffer;
+    struct regexEntry *regexes;
+    zbx_uint64_t regexClock;
+    char error[HTTP_ERROR_LENGTH];
+    pid_t pid;
+};
+
+/* records being written to a snapshot, see snapshot.c */
+struct snapshotWriter
+{
+    char *buffer;
+    size_t alloc;
+    size_t offset;
+    size_t record;
+    unsigned int count;
+    zbx_hashset_t keys;
+};
+
+/* the payload of one record of a mapped snapshot, error is set once a read ran past its end */
+struct snapshotReader
+{
+    const char *p;
+    const char *end;
+    int error;
+};
+
+struct fetchRequest
+{
+    const char *fullURL;
+    const char *user;
+    const char *password;
+    const struct targetProfile *profile;
+    struct fetchValidators *validators;
+    char *data;
+    long status;
+};
 
 size_t write_data_callback(void *contents, size_t size, size_t nmemb, void *userp);
 int curl_init(void);
-void curl_set_opt(const char *fullURL, const char *user, const char *password);
-const char *parse_data(char *data, const char *regex);
-char *get_data();
+void curl_uninit(void);
+struct fetchContext *fetch_context_create(void);
+void fetch_context_destroy(struct fetchContext *ctx);
+struct fetchContext *fetch_context_acquire(struct fetchContext **owner);
+void curl_handle_setup(CURL *handle);
+void curl_set_opt_handle(CURL *handle, const char *fullURL, const char *user, const char *password,
+                         const struct targetProfile *profile);
+char *parse_data(struct fetchContext *ctx, char *data, const char *regex);
+const char *fetch_error(const struct fetchContext *ctx, const char *message);
+char *fetch_data(struct fetchContext *ctx, const char *fullURL, const char *user, const char *password,
+                 const struct targetProfile *profile);
+char *fetch_shared(struct fetchContext *ctx, const char *key, const char *fullURL, const char *user,
+                   const char *password, const struct targetProfile *profile);
+char *fetch_shared_conditional(struct fetchContext *ctx, const char *key, const char *fullURL, const char *user,
+                               const char *password, const struct targetProfile *profile,
+                               struct fetchValidators *validators, const char *current, long *status);
+char *fetch_data_conditional(struct fetchContext *ctx, const char *fullURL, const char *user, const char *password,
+                             const struct targetProfile *profile, struct fetchValidators *validators, long *status);
+CURLM *fetch_multi_init(void);
+void fetch_multi(CURLM *multi, struct fetchRequest *requests, int count, double deadline);
+char *get_data(struct fetchContext *ctx, const struct itemRequest *item);
+char *get_data_version(struct fetchContext *ctx, const struct itemRequest *item, zbx_uint64_t *version);
+char *get_value(struct fetchContext *ctx, const struct itemRequest *item);
+char *get_field(struct fetchContext *ctx, const struct itemRequest *item, const char *pattern);
+int is_field_name(const char *pattern);
+
+zbx_hash_t string_ptr_hash_func(const void *data);
+void cache_init(void);
+void cache_destroy(void);
+char *cache_key(const char *fullURL, const char *user, const char *password);
+char *cache_get(const char *key, zbx_uint64_t *version);
+char *cache_refresh(struct fetchContext *ctx, const struct itemRequest *item, zbx_uint64_t *version);
+zbx_uint64_t cache_version_next(void);
+int cache_value_get(const char *key, const char *pattern, zbx_uint64_t version, char **value);
+void cache_value_put(const char *key, const char *pattern, zbx_uint64_t version, const char *value);
+void cache_get_stats(struct cacheStats *out);
+void cache_snapshot_save(struct snapshotWriter *w);
+int cache_snapshot_load(int type, double time, const char *key, struct snapshotReader *r);
+char *bulk_get(struct fetchContext *ctx, const struct itemRequest *item, const char *indexKey);
+struct bulkRollup *bulk_rollup(struct fetchContext *ctx, const struct itemRequest *item, int scope,
+                               const char *statistic);
+
+void request_init(void);
+void request_destroy(void);
+struct itemRequest *request_get(AGENT_REQUEST *request);
+void request_set(struct itemRequest *item, char *fullURL, const char *user, const char *password,
+                 const struct targetProfile *profile, const char *pattern);
+void request_snapshot_save(struct snapshotWriter *w);
+int request_snapshot_load(double time, const char *key, struct snapshotReader *r);
+
+void rate_state_free(struct rateState *state);
+int rate_update(struct fetchContext *ctx, struct itemRequest *item, const char *value, int mode, double *result);
+
+int config_load(void);
+void config_destroy(void);
+const struct targetProfile *config_profile(const char *name);
+
+void breaker_init(void);
+void breaker_destroy(void);
+int breaker_allow(const char *fullURL);
+void breaker_report(const char *fullURL, int succeeded);
+
+const struct monitoringSubtree *subtree_find(const char *path, const char **indexKey);
+
+char *export_openmetrics(const char *data);
+
+void discovery_init(void);
+void discovery_destroy(void);
+char *discovery_get(struct fetchContext *ctx, const struct itemRequest *item, const char *macro);
+void discovery_snapshot_save(struct snapshotWriter *w);
+int discovery_snapshot_load(double time, const char *key, struct snapshotReader *r);
+
+void snapshot_load(void);
+void snapshot_save(void);
+void snapshot_save_due(void);
+void snapshot_record_begin(struct snapshotWriter *w, int type, double time, const char *key);
+void snapshot_record_end(struct snapshotWriter *w);
+void snapshot_put(struct snapshotWriter *w, const void *data, size_t size);
+void snapshot_put_string(struct snapshotWriter *w, const char *str);
+int snapshot_get(struct snapshotReader *r, void *data, size_t size);
+const char *snapshot_get_string(struct snapshotReader *r);
+int snapshot_usable(double fetched);
+double snapshot_refresh_time(const char *key, double window);
+
+void shm_init(void);
+void shm_destroy(void);
+int shm_lookup(const char *key, double maxAge, char **data, int *slot);
+void shm_store(int slot, const char *key, const char *data);
+void shm_release(int slot);
+void shm_fail(int slot);
+int shm_wait(const char *key, double maxAge, double deadline, char **data, int *slot);
+
+void collector_init(void);
+void collector_uninit(void);
+char *collector_get(const struct itemRequest *item, zbx_uint64_t *version);
+int collector_age(double *age);
+
+void stats_init(void);
+void stats_begin(const char *key);
+int stats_end(int ret);
+void stats_transfer(CURL *handle, int background, size_t decoded);
+void stats_parse(double seconds);
+void stats_error(void);
+int stats_get(const char *metric, const char *statistic, const char *key, double *value);
+char *stats_json(void);
+
+void json_scan_init(struct jsonScanner *js, json_value_cb onValue, void *ctx);
+int json_scan(struct jsonScanner *js, const char *data, size_t size);
+int is_json_path(const char *pattern);
+void json_path_init(struct jsonScanner *js, struct jsonPathMatch *match, const char *path);
+char *json_path_get(const char *data, const char *path);
+char *json_stats(const char *data, const char *names);
@@ -0,0 +1,503 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include "zbxjson.h"
+#include <curl/curl.h>
+#include "glassfish.h"
+
+#define JS_VALUE        0
+#define JS_KEY_OR_END   1
+#define JS_KEY          2
+#define JS_COLON        3
+#define JS_STRING       4
+#define JS_LITERAL      5
+#define JS_NEXT         6
+#define JS_VALUE_OR_END 7
+
+/*
+Incremental JSON scanner. It keeps no heap state: the stack of open containers, the current
+key of every level and the scalar being read live in struct jsonScanner, so a body can be
+fed in arbitrary chunks. Every scalar is reported to the callback together with its key path.
+*/
+void json_scan_init(struct jsonScanner *js, json_value_cb onValue, void *ctx)
+{
+    js->state = JS_VALUE;
+    js->depth = 0;
+    js->escape = 0;
+    js->tokenLength = 0;
+    js->onValue = onValue;
+    js->ctx = ctx;
+    js->result = JSON_SCAN_MORE;
+}
+
+/*
+*/
+static void json_token_add(struct jsonScanner *js, char c)
+{
+    if (js->tokenLength < JSON_VALUE_LENGTH - 1)
+        js->token[js->tokenLength++] = c;
+}
+
+/*
+*/
+static int json_open(struct jsonScanner *js, char type)
+{
+    if (js->depth == JSON_MAX_DEPTH)
+        return FAIL;
+
+    js->type[js->depth] = type;
+    js->keys[js->depth][0] = '\0';
+    js->index[js->depth] = 0;
+    js->depth++;
+
+    js->state = (type == '{' ? JS_KEY_OR_END : JS_VALUE_OR_END);
+    return SUCCEED;
+}
+
+/*
+*/
+static int json_close(struct jsonScanner *js, char type)
+{
+    if (js->depth == 0 || js->type[js->depth - 1] != type)
+        return FAIL;
+
+    if (--js->depth == 0)
+        js->result = JSON_SCAN_DONE;
+
+    js->state = JS_NEXT;
+    return SUCCEED;
+}
+
+/*
+*/
+static void json_emit(struct jsonScanner *js, int isString)
+{
+    js->token[js->tokenLength] = '\0';
+
+    if (js->depth > 0 && js->type[js->depth - 1] == '[')
+        zbx_snprintf(js->keys[js->depth - 1], JSON_KEY_LENGTH, "%d", js->index[js->depth - 1]);
+
+    if (js->onValue != NULL && js->onValue(js, js->token, isString, js->ctx) != 0)
+        js->result = JSON_SCAN_DONE;
+
+    js->tokenLength = 0;
+    js->state = JS_NEXT;
+}
+
+/*
+*/
+static int json_is_delimiter(char c)
+{
+    return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/*
+*/
+static int json_start_value(struct jsonScanner *js, char c)
+{
+    switch (c)
+    {
+        case '{':
+        case '[':
+            if (js->depth > 0 && js->type[js->depth - 1] == '[')
+                zbx_snprintf(js->keys[js->depth - 1], JSON_KEY_LENGTH, "%d", js->index[js->depth - 1]);
+            return json_open(js, c);
+        case '"':
+            js->tokenLength = 0;
+            js->state = JS_STRING;
+            return SUCCEED;
+        default:
+            if (c != '-' && !isalnum((unsigned char)c))
+                return FAIL;
+            js->tokenLength = 0;
+            json_token_add(js, c);
+            js->state = JS_LITERAL;
+            return SUCCEED;
+    }
+}
+
+/*
+Handles one character of a string; returns 1 when the closing quote was consumed.
+*/
+static int json_string_char(struct jsonScanner *js, char c, char *out, size_t *outLength, size_t outSize)
+{
+    if (js->escape == 1)
+    {
+        js->escape = 0;
+
+        switch (c)
+        {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u':
+                js->escape = 2;
+                js->unicode = 0;
+                return 0;
+        }
+    }
+    else if (js->escape >= 2)
+    {
+        js->unicode = js->unicode * 16 + (isdigit((unsigned char)c) ? c - '0' : (tolower((unsigned char)c) - 'a' + 10));
+
+        if (++js->escape < 6)
+            return 0;
+
+        js->escape = 0;
+        c = (js->unicode < 0x80 ? (char)js->unicode : '?');
+    }
+    else if (c == '\\')
+    {
+        js->escape = 1;
+        return 0;
+    }
+    else if (c == '"')
+    {
+        return 1;
+    }
+
+    if (*outLength < outSize - 1)
+        out[(*outLength)++] = c;
+
+    return 0;
+}
+
+/*
+Feeds size bytes to the scanner. Returns JSON_SCAN_MORE while the document is incomplete,
+JSON_SCAN_DONE once it is complete or the callback asked to stop, JSON_SCAN_ERROR otherwise.
+*/
+int json_scan(struct jsonScanner *js, const char *data, size_t size)
+{
+    const char *p, *end = data + size;
+    size_t keyLength;
+
+    for (p = data; p < end && js->result == JSON_SCAN_MORE; p++)
+    {
+        char c = *p;
+
+        switch (js->state)
+        {
+            case JS_VALUE:
+            case JS_VALUE_OR_END:
+                if (isspace((unsigned char)c))
+                    break;
+                if (c == ']' && js->state == JS_VALUE_OR_END)
+                {
+                    if (json_close(js, '[') != SUCCEED)
+                        js->result = JSON_SCAN_ERROR;
+                    break;
+                }
+                if (json_start_value(js, c) != SUCCEED)
+                    js->result = JSON_SCAN_ERROR;
+                break;
+            case JS_KEY_OR_END:
+                if (isspace((unsigned char)c))
+                    break;
+                if (c == '}')
+                {
+                    if (json_close(js, '{') != SUCCEED)
+                        js->result = JSON_SCAN_ERROR;
+                    break;
+                }
+                if (c != '"')
+                {
+                    js->result = JSON_SCAN_ERROR;
+                    break;
+                }
+                js->tokenLength = 0;
+                js->state = JS_KEY;
+                break;
+            case JS_KEY:
+                keyLength = js->tokenLength;
+                if (json_string_char(js, c, js->keys[js->depth - 1], &keyLength, JSON_KEY_LENGTH) == 1)
+                {
+                    js->keys[js->depth - 1][keyLength] = '\0';
+                    js->tokenLength = 0;
+                    js->state = JS_COLON;
+                    break;
+                }
+                js->tokenLength = keyLength;
+                break;
+            case JS_COLON:
+                if (isspace((unsigned char)c))
+                    break;
+                if (c != ':')
+                    js->result = JSON_SCAN_ERROR;
+                else
+                    js->state = JS_VALUE;
+                break;
+            case JS_STRING:
+                if (json_string_char(js, c, js->token, &js->tokenLength, JSON_VALUE_LENGTH) == 1)
+                    json_emit(js, 1);
+                break;
+            case JS_LITERAL:
+                if (!json_is_delimiter(c))
+                {
+                    json_token_add(js, c);
+                    break;
+                }
+                json_emit(js, 0);
+                if (js->result != JSON_SCAN_MORE)
+                    break;
+                /* the delimiter belongs to the enclosing container */
+                /* break omitted intentionally */
+            case JS_NEXT:
+                if (isspace((unsigned char)c))
+                    break;
+                if (js->depth == 0)
+                {
+                    js->result = JSON_SCAN_ERROR;
+                    break;
+                }
+                if (c == ',')
+                {
+                    if (js->type[js->depth - 1] == '{')
+                    {
+                        js->state = JS_KEY_OR_END;
+                    }
+                    else
+                    {
+                        js->index[js->depth - 1]++;
+                        js->state = JS_VALUE;
+                    }
+                    break;
+                }
+                if ((c == '}' || c == ']') && json_close(js, c == '}' ? '{' : '[') == SUCCEED)
+                    break;
+                js->result = JSON_SCAN_ERROR;
+                break;
+        }
+    }
+
+    return js->result;
+}
+
+/*
+A JSON path is a dot separated list of keys, optionally prefixed with "$.", for example
+"extraProperties.entity.count200.count". Array elements are addressed by their index.
+*/
+int is_json_path(const char *pattern)
+{
+    const char *p;
+
+    if (strncmp(pattern, "$.", 2) == 0)
+        pattern += 2;
+
+    if (*pattern == '\0' || *pattern == '.')
+        return 0;
+
+    for (p = pattern; *p != '\0'; p++)
+    {
+        if (*p == '.' && (p[1] == '.' || p[1] == '\0'))
+            return 0;
+
+        if (*p != '.' && !isalnum((unsigned char)*p) && *p != '_' && *p != '-')
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+Compares the key path of the current scalar with the JSON path, without copying either.
+*/
+static int json_path_value(struct jsonScanner *js, const char *value, int isString, void *ctx)
+{
+    struct jsonPathMatch *match = (struct jsonPathMatch *)ctx;
+    const char *p = match->path;
+    size_t length;
+    int i;
+
+    for (i = 0; i < js->depth; i++)
+    {
+        length = strcspn(p, ".");
+
+        if (length != strlen(js->keys[i]) || strncmp(p, js->keys[i], length) != 0)
+            return 0;
+
+        p += length;
+
+        if (*p == '.')
+            p++;
+        else if (i + 1 < js->depth)
+            return 0;
+    }
+
+    if (*p != '\0')
+        return 0;
+
+    zbx_strlcpy(match->value, value, sizeof(match->value));
+    match->found = 1;
+
+    return 1;
+}
+
+/*
+Prepares a scanner that stops at the first scalar found under path.
+*/
+void json_path_init(struct jsonScanner *js, struct jsonPathMatch *match, const char *path)
+{
+    if (strncmp(path, "$.", 2) == 0)
+        path += 2;
+
+    match->path = path;
+    match->value[0] = '\0';
+    match->found = 0;
+
+    json_scan_init(js, json_path_value, match);
+}
+
+/*
+Returns a copy of the scalar under path in a complete body, or NULL if there is none.
+*/
+char *json_path_get(const char *data, const char *path)
+{
+    struct jsonScanner js;
+    struct jsonPathMatch match;
+    double started = zbx_time();
+
+    json_path_init(&js, &match, path);
+    json_scan(&js, data, strlen(data));
+    stats_parse(zbx_time() - started);
+
+    if (match.found == 0)
+        return NULL;
+
+    return zbx_strdup(NULL, match.value);
+}
+
+/* statistic requested from json_stats() */
+struct jsonStat
+{
+    const char *name;
+    const char *field;
+    char value[JSON_VALUE_LENGTH];
+    int isString;
+    int rank;
+};
+
+struct jsonStatList
+{
+    struct jsonStat *stats;
+    int count;
+};
+
+/*
+Picks extraProperties.entity.<statistic>.<field> values. Without an explicit field "current"
+is preferred over "count", so range and count statistics can be mixed in one list.
+*/
+static int json_stat_value(struct jsonScanner *js, const char *value, int isString, void *ctx)
+{
+    struct jsonStatList *list = (struct jsonStatList *)ctx;
+    struct jsonStat *stat;
+    int i, rank;
+
+    if (js->depth != 4 || strcmp(js->keys[0], "extraProperties") != 0 || strcmp(js->keys[1], "entity") != 0)
+        return 0;
+
+    for (i = 0; i < list->count; i++)
+    {
+        stat = &list->stats[i];
+
+        if (strcmp(stat->name, js->keys[2]) != 0)
+            continue;
+
+        if (stat->field != NULL)
+            rank = (strcmp(stat->field, js->keys[3]) == 0 ? 2 : 0);
+        else if (strcmp(js->keys[3], "current") == 0)
+            rank = 2;
+        else if (strcmp(js->keys[3], "count") == 0)
+            rank = 1;
+        else
+            rank = 0;
+
+        if (rank > stat->rank)
+        {
+            zbx_strlcpy(stat->value, value, sizeof(stat->value));
+            stat->isString = isString;
+            stat->rank = rank;
+        }
+    }
+
+    return 0;
+}
+
+/*
+Returns a JSON object with the requested statistics of a monitoring response, for example
+{"numconnused":3,"numconnfree":5} for the list "numconnused,numconnfree". An entry may name
+the field, as in "numconnused.highwatermark". Statistics missing from the response are left
+out. Returns NULL if the response is not valid JSON.
+*/
+char *json_stats(const char *data, const char *names)
+{
+    struct jsonScanner js;
+    struct jsonStatList list;
+    struct zbx_json j;
+    char *copy, *name, *next, *dot, *out = NULL;
+    char label[JSON_KEY_LENGTH * 2];
+    int i;
+
+    copy = zbx_strdup(NULL, names);
+
+    list.count = 1;
+
+    for (name = copy; *name != '\0'; name++)
+    {
+        if (*name == ',')
+            list.count++;
+    }
+
+    list.stats = (struct jsonStat *)zbx_calloc(NULL, list.count, sizeof(struct jsonStat));
+    list.count = 0;
+
+    for (name = copy; name != NULL; name = next)
+    {
+        if ((next = strchr(name, ',')) != NULL)
+            *next++ = '\0';
+
+        zbx_lrtrim(name, " ");
+
+        if (*name == '\0')
+            continue;
+
+        if ((dot = strchr(name, '.')) != NULL)
+            *dot++ = '\0';
+
+        list.stats[list.count].name = name;
+        list.stats[list.count].field = dot;
+        list.count++;
+    }
+
+    json_scan_init(&js, json_stat_value, &list);
+
+    if (json_scan(&js, data, strlen(data)) != JSON_SCAN_ERROR)
+    {
+        zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+
+        for (i = 0; i < list.count; i++)
+        {
+            if (list.stats[i].rank == 0)
+                continue;
+
+            if (list.stats[i].field != NULL)
+                zbx_snprintf(label, sizeof(label), "%s.%s", list.stats[i].name, list.stats[i].field);
+            else
+                zbx_strlcpy(label, list.stats[i].name, sizeof(label));
+
+            zbx_json_addstring(&j, label, list.stats[i].value,
+                               (list.stats[i].isString != 0 ? ZBX_JSON_TYPE_STRING : ZBX_JSON_TYPE_INT));
+        }
+
+        out = zbx_strdup(NULL, j.buffer);
+        zbx_json_free(&j);
+    }
+
+    zbx_free(list.stats);
+    zbx_free(copy);
+
+    return out;
+}
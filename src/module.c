@@ -2,6 +2,7 @@
 #include "module.h"
 #include "common.h"
 #include "log.h"
+#include "zbxalgo.h"
 #include "pcreposix.h"
 #include "zbxregexp.h"
 #include "zbxjson.h"
@@ -14,11 +15,28 @@ static int zbx_module_glassfish_discovery_application(AGENT_REQUEST *request, AG
 static int zbx_module_glassfish_discovery_pool(AGENT_REQUEST *request, AGENT_RESULT *result);
 static int zbx_module_glassfish_ping_connection_pool(AGENT_REQUEST *request, AGENT_RESULT *result);
 static int zbx_module_glassfish_resource(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_resource_rate(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_resource_delta(AGENT_REQUEST *request, AGENT_RESULT *result);
 static int zbx_module_glassfish_resource_json(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_resource_batch(AGENT_REQUEST *request, AGENT_RESULT *result);
 static int zbx_module_glassfish_http_service(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_http_service_rate(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_http_service_delta(AGENT_REQUEST *request, AGENT_RESULT *result);
 static int zbx_module_glassfish_http_service_json(AGENT_REQUEST *request, AGENT_RESULT *result);
 static int zbx_module_glassfish_application(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_application_rate(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_application_delta(AGENT_REQUEST *request, AGENT_RESULT *result);
 static int zbx_module_glassfish_application_json(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_application_rollup(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_stat(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_export_openmetrics(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_cache_stats(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_collector_age(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_stats(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_glassfish_stats_json(AGENT_REQUEST *request, AGENT_RESULT *result);
+
+/* client state of the item handlers, the agent calls them from one thread per process */
+static struct fetchContext *handlerContext;
 
 static ZBX_METRIC keys[] =
 /* 			  KEY                          FLAG                   FUNCTION                   TEST PARAMETERS */
@@ -27,11 +45,25 @@ static ZBX_METRIC keys[] =
     {"glassfish.discovery.pool",        CF_HAVEPARAMS, zbx_module_glassfish_discovery_pool,         NULL},
     {"glassfish.ping.connection.pool",  CF_HAVEPARAMS, zbx_module_glassfish_ping_connection_pool,   NULL},
     {"glassfish.resource",              CF_HAVEPARAMS, zbx_module_glassfish_resource,               NULL},
+    {"glassfish.resource.rate",         CF_HAVEPARAMS, zbx_module_glassfish_resource_rate,          NULL},
+    {"glassfish.resource.delta",        CF_HAVEPARAMS, zbx_module_glassfish_resource_delta,         NULL},
     {"glassfish.resource.json",         CF_HAVEPARAMS, zbx_module_glassfish_resource_json,          NULL},
+    {"glassfish.resource.batch",        CF_HAVEPARAMS, zbx_module_glassfish_resource_batch,         NULL},
     {"glassfish.http.service",          CF_HAVEPARAMS, zbx_module_glassfish_http_service,           NULL},
+    {"glassfish.http.service.rate",     CF_HAVEPARAMS, zbx_module_glassfish_http_service_rate,      NULL},
+    {"glassfish.http.service.delta",    CF_HAVEPARAMS, zbx_module_glassfish_http_service_delta,     NULL},
     {"glassfish.http.service.json",     CF_HAVEPARAMS, zbx_module_glassfish_http_service_json,      NULL},
     {"glassfish.application",           CF_HAVEPARAMS, zbx_module_glassfish_application,            NULL},
+    {"glassfish.application.rate",      CF_HAVEPARAMS, zbx_module_glassfish_application_rate,       NULL},
+    {"glassfish.application.delta",     CF_HAVEPARAMS, zbx_module_glassfish_application_delta,      NULL},
     {"glassfish.application.json",      CF_HAVEPARAMS, zbx_module_glassfish_application_json,       NULL},
+    {"glassfish.application.rollup",    CF_HAVEPARAMS, zbx_module_glassfish_application_rollup,     NULL},
+    {"glassfish.stat",                  CF_HAVEPARAMS, zbx_module_glassfish_stat,                   NULL},
+    {"glassfish.export.openmetrics",    CF_HAVEPARAMS, zbx_module_glassfish_export_openmetrics,     NULL},
+    {"glassfish.cache.stats",           CF_HAVEPARAMS, zbx_module_glassfish_cache_stats,            NULL},
+    {"glassfish.collector.age",         0,             zbx_module_glassfish_collector_age,          NULL},
+    {"glassfish.stats",                 CF_HAVEPARAMS, zbx_module_glassfish_stats,                  NULL},
+    {"glassfish.stats.json",            0,             zbx_module_glassfish_stats_json,             NULL},
     {NULL}
 };
 
@@ -70,7 +102,29 @@ int zbx_module_init(void)
 	
     zabbix_log(LOG_LEVEL_INFORMATION, 
                "Module: %s - openssl: '%s', libcurl: %s, regex: %s (%s:%d)", 
-               MODULE_NAME, OPENSSL_VERSION_TEXT, "", "" , __FILE__, __LINE__ );
+               MODULE_NAME, OPENSSL_VERSION_TEXT, curl_version_info(CURLVERSION_NOW)->version, "" , __FILE__, __LINE__ );
+	
+    if (config_load() != SUCCEED)
+        return ZBX_MODULE_FAIL;
+	
+    /* before anything else is set up, so that a failure has only these two to undo */
+    if (curl_init() != CURLE_OK)
+    {
+        zabbix_log(LOG_LEVEL_ERR, "Error in module: %s - could not initilization libcurl (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        curl_uninit();
+        config_destroy();
+        return ZBX_MODULE_FAIL;
+    }
+	
+    stats_init();
+    shm_init();
+    cache_init();
+    request_init();
+    breaker_init();
+    discovery_init();
+    snapshot_load();
+    collector_init();
 	
     return ZBX_MODULE_OK;
 }
@@ -88,6 +142,18 @@ int zbx_module_init(void)
 ******************************************************************************/
 int zbx_module_uninit(void)
 {
+    snapshot_save();
+    collector_uninit();
+    fetch_context_destroy(handlerContext);
+    handlerContext = NULL;
+    curl_uninit();
+    discovery_destroy();
+    breaker_destroy();
+    request_destroy();
+    cache_destroy();
+    shm_destroy();
+    config_destroy();
+	
     return ZBX_MODULE_OK;
 }
 	
@@ -105,453 +171,1231 @@ ZBX_METRIC *zbx_module_item_list()
     return keys;
 }
 
-/*
-*/
-static int zbx_module_glassfish_discovery_application(AGENT_REQUEST *request, AGENT_RESULT *result)
+/* where the item key asks, from its own parameters or from a profile of glassfish.conf */
+struct itemTarget
 {
-    return SYSINFO_RET_OK;
-}
+    const char *host;
+    const char *port;
+    const char *user;
+    const char *password;
+    const struct targetProfile *profile;
+    int first;
+};
 
 /*
+An item key either starts with host and port and ends with user and password, nparam
+parameters in all, or starts with the name of a profile from glassfish.conf instead of
+those four. first is the index of the parameter that follows host and port or the profile.
+Sets the result and returns FAIL if the item key is neither.
 */
-static int zbx_module_glassfish_discovery_pool(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int item_target(AGENT_REQUEST *request, int nparam, struct itemTarget *target, AGENT_RESULT *result)
 {
-    return SYSINFO_RET_OK;
+    const char *name;
+	
+    if (request->nparam == nparam)
+    {
+        target->host = get_rparam(request, 0);
+        target->port = get_rparam(request, 1);
+        target->user = get_rparam(request, nparam - 2);
+        target->password = get_rparam(request, nparam - 1);
+        target->profile = &glassfishConfig.defaults;
+        target->first = 2;
+        return SUCCEED;
+    }
+	
+    if (request->nparam != nparam - 3)
+    {
+        SET_MSG_RESULT(result, strdup("Invalid number of parameters"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - invalid number of parameters (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return FAIL;
+    }
+	
+    name = get_rparam(request, 0);
+	
+    if (NULL == (target->profile = config_profile(name)))
+    {
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Unknown profile \"%s\"", name));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - unknown profile: %s (%s:%d)", 
+                   MODULE_NAME, name, __FILE__, __LINE__ );
+        return FAIL;
+    }
+	
+    target->host = target->profile->url;
+    target->port = target->profile->port;
+    target->user = target->profile->user;
+    target->password = target->profile->password;
+    target->first = 1;
+	
+    return SUCCEED;
 }
 
 /*
-glassfish.ping.connection.pool["https://{HOST.CONN}", 8888, "pool", "exit_code.:.(\w+).,", "user", "password"]
+glassfish.discovery.application["https://{HOST.CONN}", 8888, "user", "password"]
 */
-static int zbx_module_glassfish_ping_connection_pool(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int zbx_module_glassfish_discovery_application(AGENT_REQUEST *request, AGENT_RESULT *result)
 {
     char *data;
-    const char *dataRes;
-    int res;
-    int value;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+	
+    stats_begin("discovery.application");
 	
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
                MODULE_NAME, request->nparam, __FILE__, __LINE__ );
 	
-    if (6 != request->nparam)
-    {
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters"));
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - invalid number of parameters (%s:%d)", 
-                   MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
-    }
+    if (item_target(request, 4, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
 	
-    res = curl_init();
-    
-    if (res != CURLE_OK)
+    ctx = fetch_context_acquire(&handlerContext);
+	
+    if (ctx == NULL)
     {
         SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
         zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
+        return stats_end(SYSINFO_RET_FAIL);
     }
 	
-    char *host = get_rparam(request, 0);
-    char *port = get_rparam(request, 1);
-    char *namePool = get_rparam(request, 2);
-    char *regex = get_rparam(request, 3);
-    char *user = get_rparam(request, 4);
-    char *password = get_rparam(request, 5);
-	
-    char fullURL[URL_LENGTH];
-    zbx_snprintf(fullURL, URL_LENGTH, "%s:%s/%s/?appname=&id=%s&modulename=&targetName=&__remove_empty_entries__=true", 
-                 host, port, GLASSFISH_PING_CONNECTION_POOL, namePool);
-	
-    curl_set_opt(fullURL, user, password);
-	
-    data = get_data();
-    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - raw data: %s (%s:%d)", 
-               MODULE_NAME, data, __FILE__, __LINE__ );
+    item = request_get(request);
 	
-    dataRes = parse_data(data, regex);
-    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - parse data: %s (%s:%d)", 
-               MODULE_NAME, dataRes, __FILE__, __LINE__ );
+    if (item->fullURL == NULL)
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s", target.host, target.port, GLASSFISH_APPLICATION),
+                    target.user, target.password, target.profile, NULL);
 	
-    zbx_free(data);
+    data = discovery_get(ctx, item, "{#APPNAME}");
 	
-    if (dataRes == NULL)
+    if (data == NULL)
     {
-        SET_MSG_RESULT(result, strdup("Result is empty"));
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - result is empty (%s:%d)", 
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Discovery failed")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - discovery failed (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
+        return stats_end(SYSINFO_RET_FAIL);
     }
 	
-    if (strcmp(dataRes, "SUCCESS") == 0)
-        value = 1;
-    else
-        value = 0;
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - discovery: %s (%s:%d)", 
+               MODULE_NAME, data, __FILE__, __LINE__ );
 	
-    SET_UI64_RESULT(result, value);
-    return SYSINFO_RET_OK;
+    SET_STR_RESULT(result, data);
+	
+    return stats_end(SYSINFO_RET_OK);
 }
 
 /*
-glassfish.resource["https://{HOST.CONN}", 8888, "resource", "averageconnwaittime", "count.:(\d+),", "user", "password"]
+glassfish.discovery.pool["https://{HOST.CONN}", 8888, "user", "password"]
+glassfish.discovery.pool["prod"]
 */
-static int zbx_module_glassfish_resource(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int zbx_module_glassfish_discovery_pool(AGENT_REQUEST *request, AGENT_RESULT *result)
 {
     char *data;
-    const char *dataRes;
-    int res;
-    int value;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+	
+    stats_begin("discovery.pool");
 	
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
                MODULE_NAME, request->nparam, __FILE__, __LINE__ );
 	
-    if (7 != request->nparam)
-    {
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters"));
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - invalid number of parameters (%s:%d)", 
-                   MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
-    }
+    if (item_target(request, 4, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
 	
-    res = curl_init();
+    ctx = fetch_context_acquire(&handlerContext);
 	
-    if (res != CURLE_OK)
+    if (ctx == NULL)
     {
         SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
         zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
+        return stats_end(SYSINFO_RET_FAIL);
     }
 	
-    char *host = get_rparam(request, 0);
-    char *port = get_rparam(request, 1);
-    char *nameResource = get_rparam(request, 2);
-    char *resourceKey = get_rparam(request, 3);
-    char *regex = get_rparam(request, 4);
-    char *user = get_rparam(request, 5);
-    char *password = get_rparam(request, 6);
+    item = request_get(request);
 	
-    char fullURL[URL_LENGTH];
-    zbx_snprintf(fullURL, URL_LENGTH, "%s:%s/%s/%s/%s", 
-                 host, port, GLASSFISH_RESOURCE, nameResource, resourceKey);
+    if (item->fullURL == NULL)
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s", target.host, target.port, GLASSFISH_RESOURCE),
+                    target.user, target.password, target.profile, NULL);
 	
-    curl_set_opt(fullURL, user, password);
+    data = discovery_get(ctx, item, "{#POOLNAME}");
 	
-    data = get_data();
-    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - raw data: %s (%s:%d)", 
+    if (data == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Discovery failed")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - discovery failed (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - discovery: %s (%s:%d)", 
                MODULE_NAME, data, __FILE__, __LINE__ );
 	
-    dataRes = parse_data(data, regex);
-    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - parse data: %s (%s:%d)", 
-               MODULE_NAME, dataRes, __FILE__, __LINE__ );
+    SET_STR_RESULT(result, data);
 	
-    zbx_free(data);
+    return stats_end(SYSINFO_RET_OK);
+}
+
+/*
+Sets the rate or the delta of the counter value dataRes as the result, dataRes is freed.
+*/
+static int counter_result(struct fetchContext *ctx, struct itemRequest *item, char *dataRes, int mode,
+                          AGENT_RESULT *result)
+{
+    double value;
+    int ret;
 	
-    if (dataRes == NULL)
+    ret = rate_update(ctx, item, dataRes, mode, &value);
+    zbx_free(dataRes);
+	
+    if (ret != SUCCEED)
     {
-        SET_MSG_RESULT(result, strdup("Result is empty"));
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - result is empty (%s:%d)", 
+        SET_MSG_RESULT(result, strdup("Not enough samples yet"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - not enough samples yet (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
         return SYSINFO_RET_FAIL;
     }
 	
-    value = atoi(dataRes);
+    if (mode == COUNTER_DELTA)
+        SET_UI64_RESULT(result, (zbx_uint64_t)value);
+    else
+        SET_DBL_RESULT(result, value);
 	
-    SET_UI64_RESULT(result, value);
     return SYSINFO_RET_OK;
 }
 
 /*
-glassfish.resource.json["https://{HOST.CONN}", 8888, "resource", "averageconnwaittime", "user", "password"]
+glassfish.ping.connection.pool["https://{HOST.CONN}", 8888, "pool", "exit_code.:.(\w+).,", "user", "password"]
+glassfish.ping.connection.pool["https://{HOST.CONN}", 8888, "pool", "exit_code", "user", "password"]
 */
-static int zbx_module_glassfish_resource_json(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int zbx_module_glassfish_ping_connection_pool(AGENT_REQUEST *request, AGENT_RESULT *result)
 {
-    char *data;
-    int res;
+    char *dataRes;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+    int value;
+	
+    stats_begin("ping.connection.pool");
 	
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
                MODULE_NAME, request->nparam, __FILE__, __LINE__ );
 	
-    if (6 != request->nparam)
-    {
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters"));
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - invalid number of parameters (%s:%d)", 
-                   MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
-    }
-	
-    res = curl_init();
+    if (item_target(request, 6, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
 	
-    if (res != CURLE_OK)
+    ctx = fetch_context_acquire(&handlerContext);
+    
+    if (ctx == NULL)
     {
         SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
         zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
+        return stats_end(SYSINFO_RET_FAIL);
     }
 	
-    char *host = get_rparam(request, 0);
-    char *port = get_rparam(request, 1);
-    char *nameResource = get_rparam(request, 2);
-    char *resourceKey = get_rparam(request, 3);
-    char *user = get_rparam(request, 4);
-    char *password = get_rparam(request, 5);
+    char *namePool = get_rparam(request, target.first + 0);
+    char *regex = get_rparam(request, target.first + 1);
 	
-    char fullURL[URL_LENGTH];
-    zbx_snprintf(fullURL, URL_LENGTH, "%s:%s/%s/%s/%s", 
-                 host, port, GLASSFISH_RESOURCE, nameResource, resourceKey);
+    item = request_get(request);
 	
-    curl_set_opt(fullURL, user, password);
+    if (item->fullURL == NULL)
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s/?appname=&id=%s&modulename=&targetName=&__remove_empty_entries__=true", 
+                                       target.host, target.port, GLASSFISH_PING_CONNECTION_POOL, namePool),
+                    target.user, target.password, target.profile, regex);
+    }
 	
-    data = get_data();
-    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - raw data: %s (%s:%d)", 
-               MODULE_NAME, data, __FILE__, __LINE__ );
+    dataRes = get_value(ctx, item);
 	
-    SET_STR_RESULT(result, strdup(data));
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - parse data: %s (%s:%d)", 
+               MODULE_NAME, dataRes, __FILE__, __LINE__ );
 	
-    zbx_free(data);
+    if (dataRes == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Result is empty")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - result is empty (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
 	
-    return SYSINFO_RET_OK;
+    if (strcmp(dataRes, "SUCCESS") == 0)
+        value = 1;
+    else
+        value = 0;
+	
+    zbx_free(dataRes);
+	
+    SET_UI64_RESULT(result, value);
+    return stats_end(SYSINFO_RET_OK);
 }
 
-/*
-glassfish.http.service["https://{HOST.CONN}", 8888, "count200", "count.:(\d+),", "user", "password"]
-*/
-static int zbx_module_glassfish_http_service(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int glassfish_resource(AGENT_REQUEST *request, AGENT_RESULT *result, const char *name, int mode)
 {
-    char *data;
-    const char *dataRes;
-    int res;
+    char *dataRes;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
     int value;
 	
+    stats_begin(name);
+	
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
                MODULE_NAME, request->nparam, __FILE__, __LINE__ );
 	
-    if (6 != request->nparam)
-    {
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters"));
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - invalid number of parameters (%s:%d)", 
-                   MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
-    }
+    if (item_target(request, 7, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
 	
-    res = curl_init();
+    ctx = fetch_context_acquire(&handlerContext);
 	
-    if (res != CURLE_OK)
+    if (ctx == NULL)
     {
         SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
         zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
+        return stats_end(SYSINFO_RET_FAIL);
     }
 	
-    char *host = get_rparam(request, 0);
-    char *port = get_rparam(request, 1);
-    char *requestKey = get_rparam(request, 2);
-    char *regex = get_rparam(request, 3);
-    char *user = get_rparam(request, 4);
-    char *password = get_rparam(request, 5);
+    char *nameResource = get_rparam(request, target.first + 0);
+    char *resourceKey = get_rparam(request, target.first + 1);
+    char *regex = get_rparam(request, target.first + 2);
 	
-    char fullURL[URL_LENGTH];
-    zbx_snprintf(fullURL, URL_LENGTH, "%s:%s/%s/%s", host, port, GLASSFISH_HTTP_SERVICE, requestKey);
+    item = request_get(request);
 	
-    curl_set_opt(fullURL, user, password);
+    if (item->fullURL == NULL && is_field_name(regex))
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s?depth=%d", target.host, target.port, GLASSFISH_RESOURCE, BULK_DEPTH),
+                    target.user, target.password, target.profile, regex);
+        item->indexKey = zbx_dsprintf(NULL, "%s.%s.%s", nameResource, resourceKey, regex);
+    }
+    else if (item->fullURL == NULL)
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s/%s/%s", 
+                                       target.host, target.port, GLASSFISH_RESOURCE, nameResource, resourceKey),
+                    target.user, target.password, target.profile, regex);
+    }
 	
-    data = get_data();
-    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - raw data: %s (%s:%d)", 
-               MODULE_NAME, data, __FILE__, __LINE__ );
+    if (item->indexKey != NULL)
+        dataRes = bulk_get(ctx, item, item->indexKey);
+    else
+        dataRes = get_value(ctx, item);
 	
-    dataRes = parse_data(data, regex);
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - parse data: %s (%s:%d)", 
                MODULE_NAME, dataRes, __FILE__, __LINE__ );
 	
-    zbx_free(data);
-	
     if (dataRes == NULL)
     {
-        SET_MSG_RESULT(result, strdup("Result is empty"));
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Result is empty")));
         zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - result is empty (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
+        return stats_end(SYSINFO_RET_FAIL);
     }
 	
+    if (mode != COUNTER_VALUE)
+        return stats_end(counter_result(ctx, item, dataRes, mode, result));
+	
     value = atoi(dataRes);
+    zbx_free(dataRes);
 	
     SET_UI64_RESULT(result, value);
-    return SYSINFO_RET_OK;
+    return stats_end(SYSINFO_RET_OK);
 }
 
 /*
-glassfish.http.service.json["https://{HOST.CONN}", 8888, "count200", "user", "password"]
+glassfish.resource["https://{HOST.CONN}", 8888, "resource", "averageconnwaittime", "count.:(\d+),", "user", "password"]
+glassfish.resource["https://{HOST.CONN}", 8888, "resource", "averageconnwaittime", "count", "user", "password"]
+glassfish.resource["https://{HOST.CONN}", 8888, "resource", "averageconnwaittime", "extraProperties.entity.averageconnwaittime.count", "user", "password"]
+glassfish.resource["prod", "resource", "averageconnwaittime", "count"]
 */
-static int zbx_module_glassfish_http_service_json(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int zbx_module_glassfish_resource(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    return glassfish_resource(request, result, "resource", COUNTER_VALUE);
+}
+
+/*
+glassfish.resource.rate["https://{HOST.CONN}", 8888, "resource", "numconncreated", "count", "user", "password"]
+*/
+static int zbx_module_glassfish_resource_rate(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    return glassfish_resource(request, result, "resource.rate", COUNTER_RATE);
+}
+
+/*
+glassfish.resource.delta["https://{HOST.CONN}", 8888, "resource", "numconncreated", "count.:(\d+),", "user", "password"]
+*/
+static int zbx_module_glassfish_resource_delta(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    return glassfish_resource(request, result, "resource.delta", COUNTER_DELTA);
+}
+
+/*
+glassfish.resource.json["https://{HOST.CONN}", 8888, "resource", "averageconnwaittime", "user", "password"]
+*/
+static int zbx_module_glassfish_resource_json(AGENT_REQUEST *request, AGENT_RESULT *result)
 {
     char *data;
-    int res;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+	
+    stats_begin("resource.json");
 	
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
                MODULE_NAME, request->nparam, __FILE__, __LINE__ );
 	
-    if (5 != request->nparam)
-    {
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters"));
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - invalid number of parameters (%s:%d)", 
-                   MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
-    }
+    if (item_target(request, 6, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
 	
-    res = curl_init();
+    ctx = fetch_context_acquire(&handlerContext);
 	
-    if (res != CURLE_OK)
+    if (ctx == NULL)
     {
         SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
         zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
+        return stats_end(SYSINFO_RET_FAIL);
     }
 	
-    char *host = get_rparam(request, 0);
-    char *port = get_rparam(request, 1);
-    char *requestKey = get_rparam(request, 2);
-    char *user = get_rparam(request, 3);
-    char *password = get_rparam(request, 4);
+    char *nameResource = get_rparam(request, target.first + 0);
+    char *resourceKey = get_rparam(request, target.first + 1);
+	
+    item = request_get(request);
+	
+    if (item->fullURL == NULL)
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s/%s/%s", 
+                                       target.host, target.port, GLASSFISH_RESOURCE, nameResource, resourceKey),
+                    target.user, target.password, target.profile, NULL);
+    }
 	
-    char fullURL[URL_LENGTH];
-    zbx_snprintf(fullURL, URL_LENGTH, "%s:%s/%s/%s", 
-                 host, port, GLASSFISH_HTTP_SERVICE, requestKey);
+    data = get_data(ctx, item);
 	
-    curl_set_opt(fullURL, user, password);
+    if (data == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Request failed")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - request failed (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
 	
-    data = get_data();
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - raw data: %s (%s:%d)", 
                MODULE_NAME, data, __FILE__, __LINE__ );
 	
-    SET_STR_RESULT(result, strdup(data));
+    SET_STR_RESULT(result, data);
 	
-    zbx_free(data);
-	
-    return SYSINFO_RET_OK;
+    return stats_end(SYSINFO_RET_OK);
 }
 
 /*
-glassfish.application["https://{HOST.CONN}", 8888, "application", "activesessionscurrent", "current.:(-?\d+),", "user", "password"]
+glassfish.resource.batch["https://{HOST.CONN}", 8888, "resource", "numconnused,numconnfree,waitqueuelength", "user", "password"]
+glassfish.resource.batch["https://{HOST.CONN}", 8888, "resource", "numconnused.highwatermark,numconncreated", "user", "password"]
 */
-static int zbx_module_glassfish_application(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int zbx_module_glassfish_resource_batch(AGENT_REQUEST *request, AGENT_RESULT *result)
 {
     char *data;
-    const char *dataRes;
-    int res;
-    int value;
+    char *dataRes;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+	
+    stats_begin("resource.batch");
 	
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
                MODULE_NAME, request->nparam, __FILE__, __LINE__ );
 	
-    if (7 != request->nparam)
-    {
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters"));
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - invalid number of parameters (%s:%d)", 
-                   MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
-    }
+    if (item_target(request, 6, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
 	
-    res = curl_init();
+    ctx = fetch_context_acquire(&handlerContext);
 	
-    if (res != CURLE_OK)
+    if (ctx == NULL)
     {
         SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
         zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
+        return stats_end(SYSINFO_RET_FAIL);
     }
 	
-    char *host = get_rparam(request, 0);
-    char *port = get_rparam(request, 1);
-    char *application = get_rparam(request, 2);
-    char *requestKey = get_rparam(request, 3);
-    char *regex = get_rparam(request, 4);
-    char *user = get_rparam(request, 5);
-    char *password = get_rparam(request, 6);
+    char *nameResource = get_rparam(request, target.first + 0);
+    char *names = get_rparam(request, target.first + 1);
+	
+    item = request_get(request);
+	
+    if (item->fullURL == NULL)
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s/%s", 
+                                       target.host, target.port, GLASSFISH_RESOURCE, nameResource),
+                    target.user, target.password, target.profile, NULL);
+    }
 	
-    char fullURL[URL_LENGTH];
-    zbx_snprintf(fullURL, URL_LENGTH, "%s:%s/%s/%s/server/%s", 
-                 host, port, GLASSFISH_APPLICATION, application, requestKey);
+    data = get_data(ctx, item);
 	
-    curl_set_opt(fullURL, user, password);
+    if (data == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Request failed")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - request failed (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
 	
-    data = get_data();
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - raw data: %s (%s:%d)", 
                MODULE_NAME, data, __FILE__, __LINE__ );
 	
-    dataRes = parse_data(data, regex);
-    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - parse data: %s (%s:%d)", 
-               MODULE_NAME, dataRes, __FILE__, __LINE__ );
+    dataRes = json_stats(data, names);
 	
     zbx_free(data);
 	
     if (dataRes == NULL)
     {
-        SET_MSG_RESULT(result, strdup("Result is empty"));
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - result is empty (%s:%d)", 
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Could not parse response")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not parse response (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
+        return stats_end(SYSINFO_RET_FAIL);
     }
 	
-    value = atoi(dataRes);
-	
-    if (value < 0)
-        value = 0;
+    SET_STR_RESULT(result, dataRes);
 	
-    SET_UI64_RESULT(result, value);
-    return SYSINFO_RET_OK;
+    return stats_end(SYSINFO_RET_OK);
 }
 
-/*
-glassfish.application.json["https://{HOST.CONN}", 8888, "application", "activesessionscurrent", "user", "password"]
-*/
-static int zbx_module_glassfish_application_json(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int glassfish_http_service(AGENT_REQUEST *request, AGENT_RESULT *result, const char *name, int mode)
 {
-    char *data;
-    int res;
+    char *dataRes;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+    int value;
+	
+    stats_begin(name);
 	
     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
                MODULE_NAME, request->nparam, __FILE__, __LINE__ );
 	
-    if (6 != request->nparam)
-    {
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters"));
-        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - invalid number of parameters (%s:%d)", 
-                   MODULE_NAME, __FILE__, __LINE__ );
-        return SYSINFO_RET_FAIL;
-    }
+    if (item_target(request, 6, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
 	
-    res = curl_init();
+    ctx = fetch_context_acquire(&handlerContext);
 	
-    if (res != CURLE_OK)
+    if (ctx == NULL)
     {
         SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
         zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
                    MODULE_NAME, __FILE__, __LINE__ );
-	return SYSINFO_RET_FAIL;
+        return stats_end(SYSINFO_RET_FAIL);
     }
 	
-     char *host = get_rparam(request, 0);
-     char *port = get_rparam(request, 1);
-     char *application = get_rparam(request, 2);
-     char *requestKey = get_rparam(request, 3);
-     char *user = get_rparam(request, 4);
-     char *password = get_rparam(request, 5);
+    char *requestKey = get_rparam(request, target.first + 0);
+    char *regex = get_rparam(request, target.first + 1);
+	
+    item = request_get(request);
+	
+    if (item->fullURL == NULL && is_field_name(regex))
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s?depth=%d", target.host, target.port, GLASSFISH_HTTP_SERVICE, BULK_DEPTH),
+                    target.user, target.password, target.profile, regex);
+        item->indexKey = zbx_dsprintf(NULL, "%s.%s", requestKey, regex);
+    }
+    else if (item->fullURL == NULL)
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s/%s", target.host, target.port, GLASSFISH_HTTP_SERVICE, requestKey),
+                    target.user, target.password, target.profile, regex);
+    }
 	
-     char fullURL[URL_LENGTH];
-     zbx_snprintf(fullURL, URL_LENGTH, "%s:%s/%s/%s/server/%s", 
-                  host, port, GLASSFISH_APPLICATION, application, requestKey);
+    if (item->indexKey != NULL)
+        dataRes = bulk_get(ctx, item, item->indexKey);
+    else
+        dataRes = get_value(ctx, item);
 	
-     curl_set_opt(fullURL, user, password);
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - parse data: %s (%s:%d)", 
+               MODULE_NAME, dataRes, __FILE__, __LINE__ );
 	
-     data = get_data();
-     zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - raw data: %s (%s:%d)", 
-                MODULE_NAME, data, __FILE__, __LINE__ );
+    if (dataRes == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Result is empty")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - result is empty (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
 	
-     SET_STR_RESULT(result, strdup(data));
+    if (mode != COUNTER_VALUE)
+        return stats_end(counter_result(ctx, item, dataRes, mode, result));
 	
-     zbx_free(data);
+    value = atoi(dataRes);
+    zbx_free(dataRes);
 	
-     return SYSINFO_RET_OK;
+    SET_UI64_RESULT(result, value);
+    return stats_end(SYSINFO_RET_OK);
+}
+
+/*
+glassfish.http.service["https://{HOST.CONN}", 8888, "count200", "count.:(\d+),", "user", "password"]
+glassfish.http.service["https://{HOST.CONN}", 8888, "count200", "count", "user", "password"]
+glassfish.http.service["https://{HOST.CONN}", 8888, "count200", "extraProperties.entity.count200.count", "user", "password"]
+*/
+static int zbx_module_glassfish_http_service(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    return glassfish_http_service(request, result, "http.service", COUNTER_VALUE);
+}
+
+/*
+glassfish.http.service.rate["https://{HOST.CONN}", 8888, "count200", "count", "user", "password"]
+*/
+static int zbx_module_glassfish_http_service_rate(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    return glassfish_http_service(request, result, "http.service.rate", COUNTER_RATE);
+}
+
+/*
+glassfish.http.service.delta["https://{HOST.CONN}", 8888, "errorcount", "extraProperties.entity.errorcount.count", "user", "password"]
+*/
+static int zbx_module_glassfish_http_service_delta(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    return glassfish_http_service(request, result, "http.service.delta", COUNTER_DELTA);
+}
+
+/*
+glassfish.http.service.json["https://{HOST.CONN}", 8888, "count200", "user", "password"]
+*/
+static int zbx_module_glassfish_http_service_json(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    char *data;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+	
+    stats_begin("http.service.json");
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
+               MODULE_NAME, request->nparam, __FILE__, __LINE__ );
+	
+    if (item_target(request, 5, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
+	
+    ctx = fetch_context_acquire(&handlerContext);
+	
+    if (ctx == NULL)
+    {
+        SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    char *requestKey = get_rparam(request, target.first + 0);
+	
+    item = request_get(request);
+	
+    if (item->fullURL == NULL)
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s/%s", 
+                                       target.host, target.port, GLASSFISH_HTTP_SERVICE, requestKey),
+                    target.user, target.password, target.profile, NULL);
+    }
+	
+    data = get_data(ctx, item);
+	
+    if (data == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Request failed")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - request failed (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - raw data: %s (%s:%d)", 
+               MODULE_NAME, data, __FILE__, __LINE__ );
+	
+    SET_STR_RESULT(result, data);
+	
+    return stats_end(SYSINFO_RET_OK);
+}
+
+static int glassfish_application(AGENT_REQUEST *request, AGENT_RESULT *result, const char *name, int mode)
+{
+    char *dataRes;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+    int value;
+	
+    stats_begin(name);
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
+               MODULE_NAME, request->nparam, __FILE__, __LINE__ );
+	
+    if (item_target(request, 7, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
+	
+    ctx = fetch_context_acquire(&handlerContext);
+	
+    if (ctx == NULL)
+    {
+        SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    char *application = get_rparam(request, target.first + 0);
+    char *requestKey = get_rparam(request, target.first + 1);
+    char *regex = get_rparam(request, target.first + 2);
+	
+    item = request_get(request);
+	
+    if (item->fullURL == NULL && is_field_name(regex))
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s?depth=%d", target.host, target.port, GLASSFISH_APPLICATION, BULK_DEPTH),
+                    target.user, target.password, target.profile, regex);
+        item->indexKey = zbx_dsprintf(NULL, "%s/server.%s.%s", application, requestKey, regex);
+    }
+    else if (item->fullURL == NULL)
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s/%s/server/%s", 
+                                       target.host, target.port, GLASSFISH_APPLICATION, application, requestKey),
+                    target.user, target.password, target.profile, regex);
+    }
+	
+    if (item->indexKey != NULL)
+        dataRes = bulk_get(ctx, item, item->indexKey);
+    else
+        dataRes = get_value(ctx, item);
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - parse data: %s (%s:%d)", 
+               MODULE_NAME, dataRes, __FILE__, __LINE__ );
+	
+    if (dataRes == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Result is empty")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - result is empty (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    if (mode != COUNTER_VALUE)
+        return stats_end(counter_result(ctx, item, dataRes, mode, result));
+	
+    value = atoi(dataRes);
+    zbx_free(dataRes);
+	
+    if (value < 0)
+        value = 0;
+	
+    SET_UI64_RESULT(result, value);
+    return stats_end(SYSINFO_RET_OK);
+}
+
+/*
+glassfish.application["https://{HOST.CONN}", 8888, "application", "activesessionscurrent", "current.:(-?\d+),", "user", "password"]
+glassfish.application["https://{HOST.CONN}", 8888, "application", "activesessionscurrent", "current", "user", "password"]
+glassfish.application["https://{HOST.CONN}", 8888, "application", "activesessionscurrent", "extraProperties.entity.activesessionscurrent.current", "user", "password"]
+*/
+static int zbx_module_glassfish_application(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    return glassfish_application(request, result, "application", COUNTER_VALUE);
+}
+
+/*
+glassfish.application.rate["https://{HOST.CONN}", 8888, "application", "requestcount", "count", "user", "password"]
+*/
+static int zbx_module_glassfish_application_rate(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    return glassfish_application(request, result, "application.rate", COUNTER_RATE);
+}
+
+/*
+glassfish.application.delta["https://{HOST.CONN}", 8888, "application", "errorcount", "count", "user", "password"]
+*/
+static int zbx_module_glassfish_application_delta(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    return glassfish_application(request, result, "application.delta", COUNTER_DELTA);
+}
+
+/*
+Orders rollup applications by their total, highest first.
+*/
+static int rollup_application_compare(const void *d1, const void *d2)
+{
+    const struct rollupApplication *application1 = *(const struct rollupApplication * const *)d1;
+    const struct rollupApplication *application2 = *(const struct rollupApplication * const *)d2;
+	
+    if (application1->value != application2->value)
+        return (application1->value < application2->value ? 1 : -1);
+	
+    return strcmp(application1->name, application2->name);
+}
+
+/*
+Returns [{"application":"app1","value":12},...] with the count applications of the rollup
+that have the highest totals.
+*/
+static char *rollup_top(struct bulkRollup *rollup, int count)
+{
+    struct rollupApplication **applications, *application;
+    zbx_hashset_iter_t iter;
+    struct zbx_json j;
+    char value[JSON_VALUE_LENGTH], *out;
+    int i, n = 0;
+	
+    applications = (struct rollupApplication **)zbx_malloc(NULL, sizeof(*applications) *
+                                                           (rollup->applications.num_data + 1));
+	
+    zbx_hashset_iter_reset(&rollup->applications, &iter);
+	
+    while (NULL != (application = (struct rollupApplication *)zbx_hashset_iter_next(&iter)))
+        applications[n++] = application;
+	
+    qsort(applications, n, sizeof(*applications), rollup_application_compare);
+	
+    zbx_json_initarray(&j, ZBX_JSON_STAT_BUF_LEN);
+	
+    for (i = 0; i < n && i < count; i++)
+    {
+        zbx_snprintf(value, sizeof(value), "%.15g", applications[i]->value);
+        zbx_json_addobject(&j, NULL);
+        zbx_json_addstring(&j, "application", applications[i]->name, ZBX_JSON_TYPE_STRING);
+        zbx_json_addstring(&j, "value", value, ZBX_JSON_TYPE_INT);
+        zbx_json_close(&j);
+    }
+	
+    out = zbx_strdup(NULL, j.buffer);
+    zbx_json_free(&j);
+    zbx_free(applications);
+	
+    return out;
+}
+
+/*
+glassfish.application.rollup["prod", "application", "activesessionscurrent", "current", "sum"]
+glassfish.application.rollup["prod", "servlet", "errorcount", "count", "max"]
+glassfish.application.rollup["prod", "servlet", "errorcount", "count", "top5"]
+glassfish.application.rollup["https://{HOST.CONN}", 8888, "application", "sessionstotal", "count", "avg", "user", "password"]
+
+The function is sum, min, max, avg, count or topN, the N applications with the highest totals
+(ROLLUP_TOP without N). With the servlet scope an application totals all its servlets.
+*/
+static int zbx_module_glassfish_application_rollup(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    struct bulkRollup *rollup;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+    char *statistic;
+    int scope, top;
+	
+    stats_begin("application.rollup");
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
+               MODULE_NAME, request->nparam, __FILE__, __LINE__ );
+	
+    if (item_target(request, 8, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
+	
+    ctx = fetch_context_acquire(&handlerContext);
+	
+    if (ctx == NULL)
+    {
+        SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    char *scopeName = get_rparam(request, target.first + 0);
+    char *name = get_rparam(request, target.first + 1);
+    char *field = get_rparam(request, target.first + 2);
+    char *function = get_rparam(request, target.first + 3);
+	
+    if (strcmp(scopeName, "application") == 0)
+        scope = ROLLUP_APPLICATION;
+    else if (strcmp(scopeName, "servlet") == 0)
+        scope = ROLLUP_SERVLET;
+    else
+    {
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Invalid scope \"%s\", use application or servlet", scopeName));
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    item = request_get(request);
+	
+    if (item->fullURL == NULL)
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s?depth=%d", target.host, target.port, GLASSFISH_APPLICATION, BULK_DEPTH),
+                    target.user, target.password, target.profile, NULL);
+    }
+	
+    statistic = zbx_dsprintf(NULL, "%s.%s", name, field);
+    rollup = bulk_rollup(ctx, item, scope, statistic);
+    zbx_free(statistic);
+	
+    if (rollup == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Request failed")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - request failed (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    if (strncmp(function, "top", 3) == 0)
+    {
+        top = (function[3] != '\0' ? atoi(function + 3) : ROLLUP_TOP);
+	
+        if (top <= 0)
+        {
+            SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Invalid function \"%s\"", function));
+            return stats_end(SYSINFO_RET_FAIL);
+        }
+	
+        SET_TEXT_RESULT(result, rollup_top(rollup, top));
+        return stats_end(SYSINFO_RET_OK);
+    }
+	
+    if (strcmp(function, "count") == 0)
+    {
+        SET_UI64_RESULT(result, rollup->count);
+        return stats_end(SYSINFO_RET_OK);
+    }
+	
+    if (strcmp(function, "sum") == 0)
+    {
+        SET_DBL_RESULT(result, rollup->sum);
+        return stats_end(SYSINFO_RET_OK);
+    }
+	
+    if (strcmp(function, "min") != 0 && strcmp(function, "max") != 0 && strcmp(function, "avg") != 0)
+    {
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Invalid function \"%s\"", function));
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    if (rollup->count == 0)
+    {
+        SET_MSG_RESULT(result, strdup("No application has this statistic"));
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    if (strcmp(function, "min") == 0)
+        SET_DBL_RESULT(result, rollup->min);
+    else if (strcmp(function, "max") == 0)
+        SET_DBL_RESULT(result, rollup->max);
+    else
+        SET_DBL_RESULT(result, rollup->sum / rollup->count);
+	
+    return stats_end(SYSINFO_RET_OK);
+}
+
+/*
+glassfish.application.json["https://{HOST.CONN}", 8888, "application", "activesessionscurrent", "user", "password"]
+*/
+static int zbx_module_glassfish_application_json(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    char *data;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+	
+    stats_begin("application.json");
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
+               MODULE_NAME, request->nparam, __FILE__, __LINE__ );
+	
+    if (item_target(request, 6, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
+	
+    ctx = fetch_context_acquire(&handlerContext);
+	
+    if (ctx == NULL)
+    {
+        SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    char *application = get_rparam(request, target.first + 0);
+    char *requestKey = get_rparam(request, target.first + 1);
+	
+    item = request_get(request);
+	
+    if (item->fullURL == NULL)
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s/%s/server/%s", 
+                                       target.host, target.port, GLASSFISH_APPLICATION, application, requestKey),
+                    target.user, target.password, target.profile, NULL);
+    }
+	
+    data = get_data(ctx, item);
+	
+    if (data == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Request failed")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - request failed (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - raw data: %s (%s:%d)", 
+               MODULE_NAME, data, __FILE__, __LINE__ );
+	
+    SET_STR_RESULT(result, data);
+	
+    return stats_end(SYSINFO_RET_OK);
+}
+
+/*
+glassfish.stat["prod", "jvm/memory.usedheapsize-count.count"]
+glassfish.stat["prod", "jvm/thread-system.threadcount.count"]
+glassfish.stat["prod", "network/http-listener-1/thread-pool.currentthreadsbusy.count"]
+glassfish.stat["https://{HOST.CONN}", 8888, "jvm/garbage-collectors/PS MarkSweep.collectioncount-count.count", "user", "password"]
+*/
+static int zbx_module_glassfish_stat(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    const struct monitoringSubtree *subtree;
+    const char *indexKey;
+    char *dataRes;
+    struct itemRequest *item;
+    struct itemTarget target;
+    zbx_uint64_t value;
+    struct fetchContext *ctx;
+	
+    stats_begin("stat");
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
+               MODULE_NAME, request->nparam, __FILE__, __LINE__ );
+	
+    if (item_target(request, 5, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
+	
+    ctx = fetch_context_acquire(&handlerContext);
+	
+    if (ctx == NULL)
+    {
+        SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    char *path = get_rparam(request, target.first + 0);
+	
+    item = request_get(request);
+	
+    if (item->fullURL == NULL)
+    {
+        if (NULL == (subtree = subtree_find(path, &indexKey)))
+        {
+            SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Unknown monitoring subtree: %s", path));
+            return stats_end(SYSINFO_RET_FAIL);
+        }
+	
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s/%s?depth=%d", 
+                                       target.host, target.port, GLASSFISH_MONITORING, subtree->name, subtree->depth),
+                    target.user, target.password, target.profile, NULL);
+        item->indexKey = zbx_strdup(NULL, indexKey);
+    }
+	
+    dataRes = bulk_get(ctx, item, item->indexKey);
+	
+    if (dataRes == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Result is empty")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - result is empty (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    /* most leaves are counters, the others are names, units and descriptions */
+    if (SUCCEED == is_uint64(dataRes, &value))
+    {
+        zbx_free(dataRes);
+        SET_UI64_RESULT(result, value);
+    }
+    else
+        SET_STR_RESULT(result, dataRes);
+	
+    return stats_end(SYSINFO_RET_OK);
+}
+
+/*
+glassfish.export.openmetrics["prod"]
+glassfish.export.openmetrics["https://{HOST.CONN}", 8888, "user", "password"]
+*/
+static int zbx_module_glassfish_export_openmetrics(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    char *data, *dataRes;
+    struct itemRequest *item;
+    struct itemTarget target;
+    struct fetchContext *ctx;
+	
+    stats_begin("export.openmetrics");
+	
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - param num: %d (%s:%d)", 
+               MODULE_NAME, request->nparam, __FILE__, __LINE__ );
+	
+    if (item_target(request, 4, &target, result) != SUCCEED)
+        return stats_end(SYSINFO_RET_FAIL);
+	
+    ctx = fetch_context_acquire(&handlerContext);
+	
+    if (ctx == NULL)
+    {
+        SET_MSG_RESULT(result, strdup("Error initilization libcurl"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not initilization libcurl (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    item = request_get(request);
+	
+    if (item->fullURL == NULL)
+    {
+        request_set(item, zbx_dsprintf(NULL, "%s:%s/%s?depth=%d", 
+                                       target.host, target.port, GLASSFISH_MONITORING, EXPORT_DEPTH),
+                    target.user, target.password, target.profile, NULL);
+    }
+	
+    data = get_data(ctx, item);
+	
+    if (data == NULL)
+    {
+        SET_MSG_RESULT(result, strdup(fetch_error(ctx, "Request failed")));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - request failed (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    dataRes = export_openmetrics(data);
+	
+    zbx_free(data);
+	
+    if (dataRes == NULL)
+    {
+        SET_MSG_RESULT(result, strdup("Could not parse response"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - could not parse response (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return stats_end(SYSINFO_RET_FAIL);
+    }
+	
+    SET_TEXT_RESULT(result, dataRes);
+	
+    return stats_end(SYSINFO_RET_OK);
+}
+
+/*
+glassfish.cache.stats["hits"]
+glassfish.cache.stats[]
+*/
+static int zbx_module_glassfish_cache_stats(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    struct cacheStats stats;
+    struct zbx_json j;
+    char *mode;
+	
+    if (1 < request->nparam)
+    {
+        SET_MSG_RESULT(result, strdup("Invalid number of parameters"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - invalid number of parameters (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return SYSINFO_RET_FAIL;
+    }
+	
+    cache_get_stats(&stats);
+	
+    mode = get_rparam(request, 0);
+	
+    if (mode == NULL || *mode == '\0')
+    {
+        zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+        zbx_json_adduint64(&j, "hits", stats.hits);
+        zbx_json_adduint64(&j, "misses", stats.misses);
+        zbx_json_adduint64(&j, "evictions", stats.evictions);
+        zbx_json_adduint64(&j, "entries", stats.entries);
+        zbx_json_adduint64(&j, "unchanged", stats.unchanged);
+        zbx_json_adduint64(&j, "reused", stats.reused);
+        zbx_json_adduint64(&j, "restored", stats.restored);
+        zbx_json_adduint64(&j, "stale", stats.stale);
+	
+        SET_STR_RESULT(result, strdup(j.buffer));
+        zbx_json_free(&j);
+        return SYSINFO_RET_OK;
+    }
+	
+    if (strcmp(mode, "hits") == 0)
+        SET_UI64_RESULT(result, stats.hits);
+    else if (strcmp(mode, "misses") == 0)
+        SET_UI64_RESULT(result, stats.misses);
+    else if (strcmp(mode, "evictions") == 0)
+        SET_UI64_RESULT(result, stats.evictions);
+    else if (strcmp(mode, "entries") == 0)
+        SET_UI64_RESULT(result, stats.entries);
+    else if (strcmp(mode, "unchanged") == 0)
+        SET_UI64_RESULT(result, stats.unchanged);
+    else if (strcmp(mode, "reused") == 0)
+        SET_UI64_RESULT(result, stats.reused);
+    else if (strcmp(mode, "restored") == 0)
+        SET_UI64_RESULT(result, stats.restored);
+    else if (strcmp(mode, "stale") == 0)
+        SET_UI64_RESULT(result, stats.stale);
+    else
+    {
+        SET_MSG_RESULT(result, strdup("Invalid first parameter"));
+        return SYSINFO_RET_FAIL;
+    }
+	
+    return SYSINFO_RET_OK;
+}
+
+/*
+glassfish.collector.age
+*/
+static int zbx_module_glassfish_collector_age(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    double age;
+	
+    if (collector_age(&age) != SUCCEED)
+    {
+        SET_MSG_RESULT(result, strdup("Collector has not published any data yet"));
+        return SYSINFO_RET_FAIL;
+    }
+	
+    SET_DBL_RESULT(result, age);
+    return SYSINFO_RET_OK;
+}
+
+/*
+glassfish.stats["latency", "p99", "resource"]
+glassfish.stats["errors", "", "http.service"]
+glassfish.stats["bytes_saved", "", "resource.json"]
+*/
+static int zbx_module_glassfish_stats(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    double value;
+	
+    if (3 != request->nparam)
+    {
+        SET_MSG_RESULT(result, strdup("Invalid number of parameters"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Error in module: %s - invalid number of parameters (%s:%d)", 
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return SYSINFO_RET_FAIL;
+    }
+	
+    char *metric = get_rparam(request, 0);
+    char *statistic = get_rparam(request, 1);
+    char *key = get_rparam(request, 2);
+	
+    if (stats_get(metric, statistic, key, &value) != SUCCEED)
+    {
+        SET_MSG_RESULT(result, strdup("Invalid parameters"));
+        return SYSINFO_RET_FAIL;
+    }
+	
+    SET_DBL_RESULT(result, value);
+    return SYSINFO_RET_OK;
+}
+
+/*
+glassfish.stats.json
+*/
+static int zbx_module_glassfish_stats_json(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    SET_STR_RESULT(result, stats_json());
+    return SYSINFO_RET_OK;
 }
@@ -0,0 +1,135 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include <curl/curl.h>
+#include "glassfish.h"
+
+/*
+*/
+void rate_state_free(struct rateState *state)
+{
+    zbx_free(state->startPattern);
+    zbx_free(state->samplePattern);
+    zbx_free(state);
+}
+
+/*
+Builds the pattern selecting field of the statistic the counter pattern of the request
+points to: "count200.count" becomes "count200.starttime" in a bulk index or a JSON path.
+A regex item points to the node of a single statistic, the field is looked for anywhere in it.
+*/
+static char *rate_field_pattern(const struct itemRequest *item, const char *field)
+{
+    const char *pattern = (item->indexKey != NULL ? item->indexKey : item->pattern), *last;
+
+    if (item->indexKey == NULL && !is_json_path(pattern))
+        return zbx_dsprintf(NULL, "\"%s\"\\s*:\\s*(\\d+)", field);
+
+    if ((last = strrchr(pattern, '.')) == NULL)
+        return zbx_strdup(NULL, field);
+
+    return zbx_dsprintf(NULL, "%.*s.%s", (int)(last - pattern), pattern, field);
+}
+
+/*
+*/
+static zbx_uint64_t rate_field(struct fetchContext *ctx, const struct itemRequest *item, const char *pattern)
+{
+    zbx_uint64_t value = 0;
+    char *data;
+
+    if ((data = get_field(ctx, item, pattern)) != NULL)
+    {
+        value = strtoull(data, NULL, 10);
+        zbx_free(data);
+    }
+
+    return value;
+}
+
+/*
+Adds the counter value of this poll to the samples of the request. A counter restarted
+when its starttime changed, its lastsampletime went back or, if GlassFish did not send
+those, its value dropped; the samples before that are dropped.
+
+With mode COUNTER_DELTA *result is the increase since the previous poll, after a restart the
+value itself. With COUNTER_RATE it is the increase per second over the samples kept, right
+after a restart the value divided by the time since starttime. Returns FAIL if there is no
+result yet.
+*/
+int rate_update(struct fetchContext *ctx, struct itemRequest *item, const char *value, int mode, double *result)
+{
+    struct rateState *state;
+    struct rateSample *oldest, *newest, sample;
+    zbx_uint64_t startTime, lastSampleTime;
+    int ret = FAIL, reset = 0;
+
+    if (NULL == (state = item->rate))
+        state = item->rate = (struct rateState *)zbx_calloc(NULL, 1, sizeof(struct rateState));
+
+    /* the samples of a request restored from the snapshot come without patterns */
+    if (state->startPattern == NULL)
+    {
+        state->startPattern = rate_field_pattern(item, "starttime");
+        state->samplePattern = rate_field_pattern(item, "lastsampletime");
+    }
+
+    sample.clock = zbx_time();
+    sample.value = atof(value);
+    startTime = rate_field(ctx, item, state->startPattern);
+    lastSampleTime = rate_field(ctx, item, state->samplePattern);
+
+    /* the slot at next is the oldest once the ring is full */
+    oldest = &state->samples[state->count < RATE_SAMPLES ? 0 : state->next];
+    newest = &state->samples[(state->next + RATE_SAMPLES - 1) % RATE_SAMPLES];
+
+    if (state->count != 0 && ((startTime != 0 && state->startTime != 0 && startTime != state->startTime) ||
+        (lastSampleTime != 0 && lastSampleTime < state->lastSampleTime) || sample.value < newest->value))
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - counter restarted: %s (%s:%d)",
+                   MODULE_NAME, item->fullURL, __FILE__, __LINE__ );
+        state->count = 0;
+        state->next = 0;
+        reset = 1;
+    }
+
+    state->startTime = startTime;
+    state->lastSampleTime = lastSampleTime;
+
+    if (state->count != 0)
+    {
+        if (mode == COUNTER_DELTA)
+        {
+            *result = sample.value - newest->value;
+            ret = SUCCEED;
+        }
+        else if (sample.clock > oldest->clock)
+        {
+            *result = (sample.value - oldest->value) / (sample.clock - oldest->clock);
+            ret = SUCCEED;
+        }
+    }
+    else if (reset != 0)
+    {
+        if (mode == COUNTER_DELTA)
+        {
+            *result = sample.value;
+            ret = SUCCEED;
+        }
+        else if (startTime != 0 && sample.clock > startTime / 1000.0)
+        {
+            *result = sample.value / (sample.clock - startTime / 1000.0);
+            ret = SUCCEED;
+        }
+    }
+
+    state->samples[state->next] = sample;
+    state->next = (state->next + 1) % RATE_SAMPLES;
+
+    if (state->count < RATE_SAMPLES)
+        state->count++;
+
+    return ret;
+}
@@ -0,0 +1,313 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include "md5.h"
+#include <curl/curl.h>
+#include "glassfish.h"
+
+/* counter samples restored from the snapshot, waiting for the first poll of their item */
+struct restoredRate
+{
+    char *key;
+    struct rateState *state;
+};
+
+static zbx_hashset_t requests;
+static zbx_hashset_t restored;
+
+/*
+*/
+static void request_clean(void *data)
+{
+    struct itemRequest *item = (struct itemRequest *)data;
+    int i;
+
+    for (i = 0; i < item->nparam; i++)
+        zbx_free(item->params[i]);
+
+    zbx_free(item->params);
+    zbx_free(item->name);
+    zbx_free(item->fullURL);
+    zbx_free(item->key);
+    zbx_free(item->user);
+    zbx_free(item->password);
+    zbx_free(item->pattern);
+    zbx_free(item->indexKey);
+
+    if (item->rate != NULL)
+        rate_state_free(item->rate);
+}
+
+/*
+*/
+static void restored_rate_clean(void *data)
+{
+    struct restoredRate *entry = (struct restoredRate *)data;
+
+    zbx_free(entry->key);
+
+    if (entry->state != NULL)
+        rate_state_free(entry->state);
+}
+
+/*
+Hashes the item key name and its parameters, so that a poll is looked up without building
+the item key string.
+*/
+static zbx_hash_t request_hash(const void *data)
+{
+    const struct itemRequest *item = (const struct itemRequest *)data;
+    zbx_hash_t hash;
+    int i;
+
+    hash = ZBX_DEFAULT_STRING_HASH_ALGO(item->name, strlen(item->name), ZBX_DEFAULT_HASH_SEED);
+
+    for (i = 0; i < item->nparam; i++)
+        hash = ZBX_DEFAULT_STRING_HASH_ALGO(item->params[i], strlen(item->params[i]), hash);
+
+    return hash;
+}
+
+/*
+*/
+static int request_compare(const void *d1, const void *d2)
+{
+    const struct itemRequest *item1 = (const struct itemRequest *)d1;
+    const struct itemRequest *item2 = (const struct itemRequest *)d2;
+    int i;
+
+    if (item1->nparam != item2->nparam)
+        return item1->nparam - item2->nparam;
+
+    for (i = 0; i < item1->nparam; i++)
+    {
+        if (strcmp(item1->params[i], item2->params[i]) != 0)
+            return strcmp(item1->params[i], item2->params[i]);
+    }
+
+    return strcmp(item1->name, item2->name);
+}
+
+/*
+*/
+void request_init(void)
+{
+    zbx_hashset_create_ext(&requests, 64, request_hash, request_compare, request_clean,
+                           ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC, ZBX_DEFAULT_MEM_FREE_FUNC);
+    zbx_hashset_create_ext(&restored, 16, STRING_PTR_HASH_FUNC, ZBX_DEFAULT_STRING_COMPARE_FUNC,
+                           restored_rate_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+                           ZBX_DEFAULT_MEM_FREE_FUNC);
+}
+
+/*
+*/
+void request_destroy(void)
+{
+    zbx_hashset_destroy(&requests);
+    zbx_hashset_destroy(&restored);
+}
+
+/*
+Drops the request polled least recently, items removed from the agent configuration
+leave their requests behind.
+*/
+static void request_make_room(void)
+{
+    zbx_hashset_iter_t iter;
+    struct itemRequest *item, *oldest = NULL;
+
+    zbx_hashset_iter_reset(&requests, &iter);
+
+    while (NULL != (item = (struct itemRequest *)zbx_hashset_iter_next(&iter)))
+    {
+        if (oldest == NULL || item->used < oldest->used)
+            oldest = item;
+    }
+
+    if (oldest != NULL)
+        zbx_hashset_remove_direct(&requests, oldest);
+}
+
+/*
+Identifies a request among the counter records of the snapshot by a digest of the item key
+name and parameters, the parameters may hold a user and a password.
+*/
+static char *request_snapshot_key(const char *name, int nparam, char **params)
+{
+    char *key = NULL;
+    size_t keyAlloc = 0, keyOffset = 0;
+    md5_state_t state;
+    md5_byte_t digest[MD5_DIGEST_SIZE];
+    int i;
+
+    zbx_md5_init(&state);
+
+    /* with the terminating nul, so that parameters cannot run into each other */
+    zbx_md5_append(&state, (const md5_byte_t *)name, strlen(name) + 1);
+
+    for (i = 0; i < nparam; i++)
+        zbx_md5_append(&state, (const md5_byte_t *)params[i], strlen(params[i]) + 1);
+
+    zbx_md5_finish(&state, digest);
+
+    for (i = 0; i < MD5_DIGEST_SIZE; i++)
+        zbx_snprintf_alloc(&key, &keyAlloc, &keyOffset, "%02x", (unsigned int)digest[i]);
+
+    return key;
+}
+
+/*
+Hands the counter samples restored for a new request over to it.
+*/
+static void request_restore(struct itemRequest *item)
+{
+    struct restoredRate *entry;
+    char *key;
+
+    if (restored.num_data == 0)
+        return;
+
+    key = request_snapshot_key(item->name, item->nparam, item->params);
+
+    if (NULL != (entry = (struct restoredRate *)zbx_hashset_search(&restored, &key)))
+    {
+        item->rate = entry->state;
+        entry->state = NULL;
+        zbx_hashset_remove_direct(&restored, entry);
+    }
+
+    zbx_free(key);
+}
+
+/*
+Returns the request built for the item key on an earlier poll. The lookup allocates
+nothing. An item key polled for the first time gets a new request without fullURL, the
+handler fills it in with request_set(), counter samples restored from the snapshot are
+attached to it. Every poll passes here, so this is also where a save of the snapshot is
+started when it is due; it is written by another thread.
+*/
+struct itemRequest *request_get(AGENT_REQUEST *request)
+{
+    struct itemRequest *item, local;
+    int i;
+
+    snapshot_save_due();
+
+    memset(&local, 0, sizeof(local));
+    local.name = request->key;
+    local.nparam = request->nparam;
+    local.params = request->params;
+
+    if (NULL != (item = (struct itemRequest *)zbx_hashset_search(&requests, &local)))
+    {
+        item->used = zbx_time();
+        return item;
+    }
+
+    if (requests.num_data >= REQUEST_MAX_ENTRIES)
+        request_make_room();
+
+    local.name = zbx_strdup(NULL, request->key);
+    local.params = (char **)zbx_malloc(NULL, sizeof(char *) * (request->nparam + 1));
+
+    for (i = 0; i < request->nparam; i++)
+        local.params[i] = zbx_strdup(NULL, request->params[i]);
+
+    local.used = zbx_time();
+    request_restore(&local);
+
+    return (struct itemRequest *)zbx_hashset_insert(&requests, &local, sizeof(local));
+}
+
+/*
+Stores what the handler built out of the item key parameters. fullURL is taken over, the
+other strings are copied; pattern may be NULL. profile outlives the request.
+*/
+void request_set(struct itemRequest *item, char *fullURL, const char *user, const char *password,
+                 const struct targetProfile *profile, const char *pattern)
+{
+    item->fullURL = fullURL;
+    item->profile = profile;
+    item->user = zbx_strdup(NULL, user);
+    item->password = zbx_strdup(NULL, password);
+    item->key = cache_key(fullURL, user, password);
+
+    if (pattern != NULL)
+        item->pattern = zbx_strdup(NULL, pattern);
+
+    zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - new request for %s: %s (%s:%d)",
+               MODULE_NAME, item->name, fullURL, __FILE__, __LINE__ );
+}
+
+/*
+Adds the counter samples of the rate and delta items to the snapshot. Samples restored from
+it whose item was not polled since are left to the copy in the file.
+*/
+void request_snapshot_save(struct snapshotWriter *w)
+{
+    zbx_hashset_iter_t iter;
+    struct itemRequest *item;
+    struct rateState *state;
+    int counts[2];
+    char *key;
+
+    zbx_hashset_iter_reset(&requests, &iter);
+
+    while (NULL != (item = (struct itemRequest *)zbx_hashset_iter_next(&iter)))
+    {
+        if ((state = item->rate) == NULL || state->count == 0 || item->fullURL == NULL)
+            continue;
+
+        key = request_snapshot_key(item->name, item->nparam, item->params);
+        counts[0] = state->count;
+        counts[1] = state->next;
+
+        snapshot_record_begin(w, SNAPSHOT_COUNTER, item->used, key);
+        snapshot_put(w, &state->startTime, sizeof(state->startTime));
+        snapshot_put(w, &state->lastSampleTime, sizeof(state->lastSampleTime));
+        snapshot_put(w, counts, sizeof(counts));
+        snapshot_put(w, state->samples, sizeof(state->samples));
+        snapshot_record_end(w);
+
+        zbx_free(key);
+    }
+}
+
+/*
+Restores the counter samples of an item saved by request_snapshot_save(). They wait for the
+first poll of the item, whose key parameters hash to key, and the next rate or delta is
+computed against them. Returns FAIL if the record is damaged or key is already known.
+*/
+int request_snapshot_load(double time, const char *key, struct snapshotReader *r)
+{
+    struct restoredRate local;
+    struct rateState *state;
+    int counts[2];
+
+    ZBX_UNUSED(time);
+
+    state = (struct rateState *)zbx_calloc(NULL, 1, sizeof(struct rateState));
+
+    snapshot_get(r, &state->startTime, sizeof(state->startTime));
+    snapshot_get(r, &state->lastSampleTime, sizeof(state->lastSampleTime));
+    snapshot_get(r, counts, sizeof(counts));
+    snapshot_get(r, state->samples, sizeof(state->samples));
+    state->count = counts[0];
+    state->next = counts[1];
+
+    if (r->error == 0 && state->count > 0 && state->count <= RATE_SAMPLES && state->next >= 0 &&
+        state->next < RATE_SAMPLES && restored.num_data < REQUEST_MAX_ENTRIES &&
+        zbx_hashset_search(&restored, &key) == NULL)
+    {
+        local.key = zbx_strdup(NULL, key);
+        local.state = state;
+        zbx_hashset_insert(&restored, &local, sizeof(local));
+        return SUCCEED;
+    }
+
+    rate_state_free(state);
+
+    return FAIL;
+}
@@ -0,0 +1,356 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include <curl/curl.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include "glassfish.h"
+
+/*
+Response bodies shared by all agent processes. The segment is mapped in zbx_module_init,
+before the agent forks its collectors, so every process sees the same slots.
+
+A slot is written only by the process that claimed it, the claim is a compare-and-swap of
+the owner pid. Readers take no lock, they copy the slot and retry if its sequence number
+changed meanwhile or is odd, which means a write is in progress.
+
+A claim is one flight: everybody asking for the key while it is claimed waits for its
+outcome instead of sending the same request. Every claim bumps the generation of the slot,
+failed holds the generation of the last flight that ended without a body, so that its
+waiters give up too, and only they: a later flight claimed within the same second is told
+apart by its generation.
+*/
+struct shmSlot
+{
+    unsigned int seq;
+    pid_t owner;
+    time_t claimed;
+    unsigned int generation;
+    unsigned int failed;
+    zbx_hash_t hash;
+    double fetched;
+    size_t length;
+    char key[SHM_KEY_LENGTH];
+    char data[SHM_SLOT_SIZE];
+};
+
+struct shmSegment
+{
+    struct shmSlot slots[SHM_SLOTS];
+};
+
+static struct shmSegment *segment;
+
+/*
+Called once from zbx_module_init. Without the segment every process fetches on its own.
+*/
+void shm_init(void)
+{
+    segment = (struct shmSegment *)mmap(NULL, sizeof(struct shmSegment), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (segment == MAP_FAILED)
+    {
+        zabbix_log(LOG_LEVEL_WARNING, "Module: %s - could not map shared memory: %s (%s:%d)",
+                   MODULE_NAME, zbx_strerror(errno), __FILE__, __LINE__ );
+        segment = NULL;
+    }
+}
+
+/*
+*/
+void shm_destroy(void)
+{
+    if (segment != NULL)
+        munmap(segment, sizeof(struct shmSegment));
+
+    segment = NULL;
+}
+
+/*
+*/
+static zbx_hash_t shm_hash(const char *key)
+{
+    zbx_hash_t hash = ZBX_DEFAULT_STRING_HASH_ALGO(key, strlen(key), ZBX_DEFAULT_HASH_SEED);
+
+    /* 0 marks an empty slot */
+    return (hash == 0 ? 1 : hash);
+}
+
+/*
+Reads the slot if it holds key. Returns FAIL if it holds another key, otherwise SUCCEED with
+*fetched set and, if the body is not older than maxAge, a copy of it in *data.
+*/
+static int shm_slot_read(struct shmSlot *slot, zbx_hash_t hash, const char *key, double maxAge, double *fetched,
+                         char **data)
+{
+    unsigned int seq;
+    size_t length;
+    int tries, ret;
+
+    for (tries = 0; tries < SHM_READ_RETRIES; tries++)
+    {
+        *data = NULL;
+        ret = FAIL;
+
+        if (((seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE)) & 1) != 0)
+        {
+            sched_yield();
+            continue;
+        }
+
+        if (slot->hash == hash && strncmp(slot->key, key, SHM_KEY_LENGTH) == 0)
+        {
+            ret = SUCCEED;
+            *fetched = slot->fetched;
+            length = slot->length;
+
+            if (*fetched + maxAge > zbx_time() && length < SHM_SLOT_SIZE)
+            {
+                *data = (char *)zbx_malloc(NULL, length + 1);
+                memcpy(*data, slot->data, length);
+                (*data)[length] = '\0';
+            }
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+            return ret;
+
+        zbx_free(*data);
+    }
+
+    return FAIL;
+}
+
+/*
+Claims the slot for the calling process. A claim older than SHM_CLAIM_TIMEOUT belongs to a
+process that died while fetching and is taken over.
+*/
+static int shm_slot_claim(struct shmSlot *slot)
+{
+    pid_t owner = 0, pid = getpid();
+    time_t now = time(NULL);
+
+    if (!__atomic_compare_exchange_n(&slot->owner, &owner, pid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        if (__atomic_load_n(&slot->claimed, __ATOMIC_RELAXED) + SHM_CLAIM_TIMEOUT > now ||
+            !__atomic_compare_exchange_n(&slot->owner, &owner, pid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            return FAIL;
+        }
+    }
+
+    __atomic_store_n(&slot->claimed, now, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&slot->generation, 1, __ATOMIC_RELEASE);
+
+    return SUCCEED;
+}
+
+/*
+Writes the slot, the caller holds the claim. An odd sequence left by a process that died
+while writing is closed as well.
+*/
+static void shm_slot_write(struct shmSlot *s, const char *key, const char *data, size_t length)
+{
+    unsigned int seq;
+
+    seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED) | 1;
+    __atomic_store_n(&s->seq, seq, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    s->hash = shm_hash(key);
+    zbx_strlcpy(s->key, key, SHM_KEY_LENGTH);
+    s->length = length;
+
+    if (data != NULL)
+    {
+        memcpy(s->data, data, length);
+        s->fetched = zbx_time();
+    }
+    else
+        s->fetched = 0;
+
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+Looks key up in the shared segment. Returns SHM_HIT with a copy of a body not older than
+maxAge in *data. Otherwise tries to claim a slot for key: SHM_CLAIMED means the caller
+fetches the body and passes it to shm_store() or gives up with shm_fail(), SHM_BUSY that
+another process is fetching it right now and shm_wait() waits for it. *slot identifies the
+claimed slot.
+*/
+int shm_lookup(const char *key, double maxAge, char **data, int *slot)
+{
+    struct shmSlot *s;
+    zbx_hash_t hash;
+    double fetched, oldest = 0;
+    int i, index, found = -1, victim = -1;
+
+    *data = NULL;
+    *slot = -1;
+
+    if (segment == NULL || strlen(key) >= SHM_KEY_LENGTH)
+        return SHM_CLAIMED;
+
+    hash = shm_hash(key);
+
+    for (i = 0; i < SHM_PROBES; i++)
+    {
+        index = (int)((hash + i) % SHM_SLOTS);
+        s = &segment->slots[index];
+
+        if (shm_slot_read(s, hash, key, maxAge, &fetched, data) == SUCCEED)
+        {
+            if (*data != NULL)
+                return SHM_HIT;
+
+            found = index;
+            break;
+        }
+
+        /* an empty slot is the best victim, otherwise the least recently fetched one */
+        if (victim == -1 || oldest > 0)
+        {
+            fetched = (__atomic_load_n(&s->hash, __ATOMIC_RELAXED) == 0 ? 0 : s->fetched);
+
+            if (victim == -1 || fetched < oldest)
+            {
+                victim = index;
+                oldest = fetched;
+            }
+        }
+    }
+
+    if (found != -1)
+    {
+        if (shm_slot_claim(&segment->slots[found]) != SUCCEED)
+            return SHM_BUSY;
+
+        *slot = found;
+        return SHM_CLAIMED;
+    }
+
+    /* the caller still fetches if the victim is busy, the body is just not shared */
+    if (shm_slot_claim(&segment->slots[victim]) != SUCCEED)
+        return SHM_CLAIMED;
+
+    /* publish the key right away, so other processes wait for this fetch */
+    shm_slot_write(&segment->slots[victim], key, NULL, 0);
+    *slot = victim;
+
+    return SHM_CLAIMED;
+}
+
+/*
+Publishes the body fetched for a slot claimed by shm_lookup() and releases the claim.
+*/
+void shm_store(int slot, const char *key, const char *data)
+{
+    struct shmSlot *s;
+    size_t length = strlen(data);
+
+    if (slot < 0 || segment == NULL)
+        return;
+
+    s = &segment->slots[slot];
+
+    if (length >= SHM_SLOT_SIZE)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - response of %d bytes is too large to share (%s:%d)",
+                   MODULE_NAME, (int)length, __FILE__, __LINE__ );
+        shm_release(slot);
+        return;
+    }
+
+    shm_slot_write(s, key, data, length);
+    shm_release(slot);
+}
+
+/*
+*/
+void shm_release(int slot)
+{
+    if (slot < 0 || segment == NULL)
+        return;
+
+    __atomic_store_n(&segment->slots[slot].owner, 0, __ATOMIC_RELEASE);
+}
+
+/*
+Releases a slot claimed by shm_lookup() after the fetch failed. The processes waiting for
+this flight fail as well rather than all sending the request again.
+*/
+void shm_fail(int slot)
+{
+    struct shmSlot *s;
+
+    if (slot < 0 || segment == NULL)
+        return;
+
+    s = &segment->slots[slot];
+    __atomic_store_n(&s->failed, __atomic_load_n(&s->generation, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    shm_release(slot);
+}
+
+/*
+Waits until deadline for the flight that claimed key to land. Returns SHM_HIT with a copy of
+the body in *data, SHM_FAILED if the flight failed, SHM_BUSY if it is still going at the
+deadline. SHM_CLAIMED means it ended without sharing a body, too large or taken over, and the
+caller fetches on its own; *slot is then -1.
+*/
+int shm_wait(const char *key, double maxAge, double deadline, char **data, int *slot)
+{
+    struct shmSlot *s;
+    zbx_hash_t hash = shm_hash(key);
+    double fetched;
+    unsigned int flight = 0;
+    int i, found, watching = 0;
+
+    *data = NULL;
+    *slot = -1;
+
+    if (segment == NULL)
+        return SHM_CLAIMED;
+
+    do
+    {
+        found = 0;
+
+        for (i = 0; i < SHM_PROBES; i++)
+        {
+            s = &segment->slots[(hash + i) % SHM_SLOTS];
+
+            if (shm_slot_read(s, hash, key, maxAge, &fetched, data) != SUCCEED)
+                continue;
+
+            if (*data != NULL)
+                return SHM_HIT;
+
+            found = 1;
+
+            if (watching == 0)
+            {
+                flight = __atomic_load_n(&s->generation, __ATOMIC_ACQUIRE);
+                watching = 1;
+            }
+
+            if (__atomic_load_n(&s->owner, __ATOMIC_ACQUIRE) != 0)
+                break;
+
+            return (__atomic_load_n(&s->failed, __ATOMIC_RELAXED) == flight ? SHM_FAILED : SHM_CLAIMED);
+        }
+
+        if (found == 0)
+            return SHM_CLAIMED;
+
+        usleep(SHM_WAIT_STEP * 1000);
+    }
+    while (zbx_time() < deadline);
+
+    return SHM_BUSY;
+}
@@ -0,0 +1,719 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include <curl/curl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <signal.h>
+#include "glassfish.h"
+
+/*
+Last-known state of the module on disk, so that a restarted agent does not start cold:
+response bodies with their validators, bulk indexes, discovery results and counter
+baselines. zbx_module_init maps the file before the agent forks, every process starts with
+what it holds. Restored bodies and indexes are served as stale until their first refresh,
+which is conditional and comes within one cache ttl, at a point of it chosen by the key so
+that the restarted agent does not ask for everything at once.
+
+The file is native binary and not meant to be moved to another host:
+
+    header      magic, version, byte order, size of the file, save time, number of records
+    record      type, size of the record, time, then the key and the payload of the type
+
+A string is its 32-bit length, the bytes and a '\0'; NULL has the length SNAPSHOT_NULL.
+Records are padded to 8 bytes. No key holds a password: cache keys end with a digest of the
+credentials, counter records are keyed by a digest of the item key parameters.
+
+Every agent process saves once every snapshot_interval, and when the module is unloaded in
+the processes that unload it; the agent collectors exit without it. The item thread only
+builds the records in memory, a writer thread of the process writes them. Records a process
+does not hold itself are copied over from the file it replaces, so processes that served
+different items keep each other's state. Saves hold an exclusive flock on <file>.lock from
+reading the old file to the rename, so processes saving together do not drop each other's
+records. The file is written under a temporary name and renamed over the old one, a reader
+sees either file whole and needs no lock.
+*/
+struct snapshotHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int order;
+    zbx_uint64_t size;
+    double saved;
+    unsigned int count;
+    unsigned int reserved;
+};
+
+struct snapshotRecord
+{
+    unsigned int type;
+    unsigned int size;
+    double time;
+};
+
+#define SNAPSHOT_NULL           0xffffffff
+#define SNAPSHOT_ALIGN          8
+
+/* writer thread of the process, started by the first save that is due */
+struct snapshotSaver
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pid_t pid;
+    int running;
+    int stop;
+    int failed;
+    double nextSave;
+    struct snapshotWriter *pending;     /* records for the thread to write, guarded by lock */
+};
+
+typedef void (*snapshot_record_cb)(const struct snapshotRecord *record, const char *key, struct snapshotReader *r,
+                                   const char *raw, void *ctx);
+
+static struct snapshotSaver saver;
+
+/*
+*/
+static void snapshot_key_clean(void *data)
+{
+    zbx_free(*(char **)data);
+}
+
+/*
+Keys of the records a process wrote itself, the type makes keys of different records unique.
+*/
+static char *snapshot_record_key(unsigned int type, const char *key)
+{
+    return zbx_dsprintf(NULL, "%u %s", type, key);
+}
+
+/*
+Returns SUCCEED if state fetched at that time is recent enough to be restored or served as
+stale, see snapshot_max_age.
+*/
+int snapshot_usable(double fetched)
+{
+    return (fetched + glassfishConfig.snapshotMaxAge > zbx_time() ? SUCCEED : FAIL);
+}
+
+/*
+Returns when within the next window seconds a restored entry is refreshed. The point is
+taken from the key, every process restoring the same file picks the same one and the
+shared memory lets one of them fetch for all.
+*/
+double snapshot_refresh_time(const char *key, double window)
+{
+    zbx_hash_t hash = ZBX_DEFAULT_STRING_HASH_ALGO(key, strlen(key), ZBX_DEFAULT_HASH_SEED);
+
+    return zbx_time() + window * ((hash % 1000) + 1) / 1000.0;
+}
+
+/*
+*/
+void snapshot_put(struct snapshotWriter *w, const void *data, size_t size)
+{
+    if (w->offset + size > w->alloc)
+    {
+        while (w->offset + size > w->alloc)
+            w->alloc = (w->alloc == 0 ? RESPONSE_BUFFER_SIZE : w->alloc * 2);
+
+        w->buffer = (char *)zbx_realloc(w->buffer, w->alloc);
+    }
+
+    memcpy(w->buffer + w->offset, data, size);
+    w->offset += size;
+}
+
+/*
+*/
+void snapshot_put_string(struct snapshotWriter *w, const char *str)
+{
+    unsigned int length = (str == NULL ? SNAPSHOT_NULL : (unsigned int)strlen(str));
+
+    snapshot_put(w, &length, sizeof(length));
+
+    if (str != NULL)
+        snapshot_put(w, str, length + 1);
+}
+
+/*
+Starts a record, the caller puts its payload and ends it with snapshot_record_end(). time is
+when its state was fetched, key identifies it among the records of its type.
+*/
+void snapshot_record_begin(struct snapshotWriter *w, int type, double time, const char *key)
+{
+    struct snapshotRecord record;
+    char *own;
+
+    record.type = (unsigned int)type;
+    record.size = 0;
+    record.time = time;
+
+    w->record = w->offset;
+    snapshot_put(w, &record, sizeof(record));
+    snapshot_put_string(w, key);
+
+    own = snapshot_record_key(record.type, key);
+
+    if (zbx_hashset_search(&w->keys, &own) == NULL)
+        zbx_hashset_insert(&w->keys, &own, sizeof(own));
+    else
+        zbx_free(own);
+}
+
+/*
+*/
+void snapshot_record_end(struct snapshotWriter *w)
+{
+    static const char padding[SNAPSHOT_ALIGN];
+    unsigned int size;
+
+    if (w->offset % SNAPSHOT_ALIGN != 0)
+        snapshot_put(w, padding, SNAPSHOT_ALIGN - w->offset % SNAPSHOT_ALIGN);
+
+    size = (unsigned int)(w->offset - w->record);
+    memcpy(w->buffer + w->record + offsetof(struct snapshotRecord, size), &size, sizeof(size));
+    w->count++;
+}
+
+/*
+Reads size bytes of the payload. Returns FAIL, and sets the error of the reader, if the
+record is shorter.
+*/
+int snapshot_get(struct snapshotReader *r, void *data, size_t size)
+{
+    if (r->error != 0 || (size_t)(r->end - r->p) < size)
+    {
+        r->error = 1;
+        memset(data, 0, size);
+        return FAIL;
+    }
+
+    memcpy(data, r->p, size);
+    r->p += size;
+
+    return SUCCEED;
+}
+
+/*
+Returns a string of the payload, it points into the mapped file. NULL is a NULL string or,
+with the error of the reader set, a string that does not fit into the record.
+*/
+const char *snapshot_get_string(struct snapshotReader *r)
+{
+    unsigned int length;
+    const char *str;
+
+    if (snapshot_get(r, &length, sizeof(length)) != SUCCEED || length == SNAPSHOT_NULL)
+        return NULL;
+
+    if ((size_t)(r->end - r->p) <= length || r->p[length] != '\0')
+    {
+        r->error = 1;
+        return NULL;
+    }
+
+    str = r->p;
+    r->p += length + 1;
+
+    return str;
+}
+
+/*
+Maps the snapshot read-only. Returns NULL if there is none or it was not written by this
+version of the module on this kind of host.
+*/
+static const char *snapshot_map(const char *path, size_t *size, struct snapshotHeader *header)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return NULL;
+
+    memcpy(header, map, sizeof(*header));
+
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || header->version != SNAPSHOT_VERSION ||
+        header->order != SNAPSHOT_ORDER || header->size != (zbx_uint64_t)st.st_size)
+    {
+        zabbix_log(LOG_LEVEL_WARNING, "Module: %s - ignoring snapshot %s, it is damaged or of another version (%s:%d)",
+                   MODULE_NAME, path, __FILE__, __LINE__ );
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+
+    *size = (size_t)st.st_size;
+
+    return (const char *)map;
+}
+
+/*
+Calls onRecord with every record of a mapped snapshot. Returns FAIL if a record does not fit
+into the file, the records before it have been passed on.
+*/
+static int snapshot_iterate(const char *map, size_t size, snapshot_record_cb onRecord, void *ctx)
+{
+    struct snapshotRecord record;
+    struct snapshotReader r;
+    const char *key;
+    size_t offset = sizeof(struct snapshotHeader);
+
+    while (offset < size)
+    {
+        if (size - offset < sizeof(record))
+            return FAIL;
+
+        memcpy(&record, map + offset, sizeof(record));
+
+        if (record.size < sizeof(record) || record.size > size - offset || record.size % SNAPSHOT_ALIGN != 0)
+            return FAIL;
+
+        r.p = map + offset + sizeof(record);
+        r.end = map + offset + record.size;
+        r.error = 0;
+
+        if ((key = snapshot_get_string(&r)) == NULL)
+            return FAIL;
+
+        onRecord(&record, key, &r, map + offset, ctx);
+        offset += record.size;
+    }
+
+    return SUCCEED;
+}
+
+/*
+*/
+static void snapshot_restore(const struct snapshotRecord *record, const char *key, struct snapshotReader *r,
+                             const char *raw, void *ctx)
+{
+    int *restored = (int *)ctx, ret;
+
+    if (snapshot_usable(record->time) != SUCCEED)
+        return;
+
+    switch (record->type)
+    {
+        case SNAPSHOT_BODY:
+        case SNAPSHOT_INDEX:
+            ret = cache_snapshot_load(record->type, record->time, key, r);
+            break;
+        case SNAPSHOT_DISCOVERY:
+            ret = discovery_snapshot_load(record->time, key, r);
+            break;
+        case SNAPSHOT_COUNTER:
+            ret = request_snapshot_load(record->time, key, r);
+            break;
+        default:
+            return;
+    }
+
+    if (ret == SUCCEED)
+        (*restored)++;
+}
+
+/*
+Called from zbx_module_init once the caches are set up. A snapshot older than
+snapshot_max_age is ignored, the agent then starts cold.
+*/
+void snapshot_load(void)
+{
+    struct snapshotHeader header;
+    const char *map, *path = glassfishConfig.snapshotFile;
+    size_t size;
+    int restored = 0;
+
+    if (glassfishConfig.snapshotInterval == 0 || path == NULL || *path == '\0')
+        return;
+
+    if ((map = snapshot_map(path, &size, &header)) == NULL)
+        return;
+
+    if (snapshot_usable(header.saved) != SUCCEED)
+    {
+        zabbix_log(LOG_LEVEL_INFORMATION, "Module: %s - snapshot %s is too old, starting cold (%s:%d)",
+                   MODULE_NAME, path, __FILE__, __LINE__ );
+        munmap((void *)map, size);
+        return;
+    }
+
+    if (snapshot_iterate(map, size, snapshot_restore, &restored) != SUCCEED)
+    {
+        zabbix_log(LOG_LEVEL_WARNING, "Module: %s - snapshot %s is truncated (%s:%d)",
+                   MODULE_NAME, path, __FILE__, __LINE__ );
+    }
+
+    munmap((void *)map, size);
+
+    zabbix_log(LOG_LEVEL_INFORMATION, "Module: %s - restored %d of %u records from %s (%s:%d)",
+               MODULE_NAME, restored, (unsigned int)header.count, path, __FILE__, __LINE__ );
+}
+
+/*
+Copies a record of the snapshot being replaced unless the process wrote its own.
+*/
+static void snapshot_keep(const struct snapshotRecord *record, const char *key, struct snapshotReader *r,
+                          const char *raw, void *ctx)
+{
+    struct snapshotWriter *w = (struct snapshotWriter *)ctx;
+    char *own;
+
+    if (snapshot_usable(record->time) != SUCCEED)
+        return;
+
+    own = snapshot_record_key(record->type, key);
+
+    if (zbx_hashset_search(&w->keys, &own) == NULL)
+    {
+        snapshot_put(w, raw, record->size);
+        w->count++;
+    }
+
+    zbx_free(own);
+}
+
+/*
+*/
+static int snapshot_write(int fd, const char *data, size_t size)
+{
+    ssize_t written;
+
+    while (size != 0)
+    {
+        if ((written = write(fd, data, size)) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return FAIL;
+        }
+
+        data += written;
+        size -= (size_t)written;
+    }
+
+    return SUCCEED;
+}
+
+/*
+Takes the lock that serializes saves of all processes. Returns the descriptor to pass to
+snapshot_unlock(), or -1 with errno set.
+*/
+static int snapshot_lock(const char *path)
+{
+    char *lockPath;
+    int fd, error;
+
+    lockPath = zbx_dsprintf(NULL, "%s.lock", path);
+    fd = open(lockPath, O_RDWR | O_CREAT, 0600);
+    zbx_free(lockPath);
+
+    if (fd == -1)
+        return -1;
+
+    while (flock(fd, LOCK_EX) != 0)
+    {
+        if (errno == EINTR)
+            continue;
+
+        error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+*/
+static void snapshot_unlock(int fd)
+{
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+/*
+Completes w with the records of the current snapshot it does not hold and writes it over
+the snapshot, the caller holds the lock. Returns FAIL with *error set if it could not.
+*/
+static int snapshot_replace(const char *path, struct snapshotWriter *w, int *error)
+{
+    struct snapshotHeader header;
+    const char *map;
+    char *tmp;
+    size_t size;
+    int fd, ret = FAIL;
+
+    if ((map = snapshot_map(path, &size, &header)) != NULL)
+    {
+        snapshot_iterate(map, size, snapshot_keep, w);
+        munmap((void *)map, size);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.order = SNAPSHOT_ORDER;
+    header.size = w->offset;
+    header.saved = zbx_time();
+    header.count = w->count;
+    memcpy(w->buffer, &header, sizeof(header));
+
+    tmp = zbx_dsprintf(NULL, "%s.%d", path, (int)getpid());
+    unlink(tmp);
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0600)) == -1)
+    {
+        *error = errno;
+        zbx_free(tmp);
+        return FAIL;
+    }
+
+    if (snapshot_write(fd, w->buffer, w->offset) == SUCCEED && fsync(fd) == 0)
+        ret = SUCCEED;
+    else
+        *error = errno;
+
+    if (close(fd) != 0 && ret == SUCCEED)
+    {
+        *error = errno;
+        ret = FAIL;
+    }
+
+    if (ret == SUCCEED && rename(tmp, path) != 0)
+    {
+        *error = errno;
+        ret = FAIL;
+    }
+
+    if (ret != SUCCEED)
+        unlink(tmp);
+
+    zbx_free(tmp);
+
+    return ret;
+}
+
+/*
+Writes the records of w, with what the current snapshot holds beyond them, over the
+snapshot and frees w. A failure is reported once as a warning, a missing directory would
+otherwise be reported on every save.
+*/
+static void snapshot_store(struct snapshotWriter *w)
+{
+    const char *path = glassfishConfig.snapshotFile;
+    double started = zbx_time();
+    int lock, error = 0, ret = FAIL;
+
+    /* the read, write and rename of one process must not interleave with another's */
+    if ((lock = snapshot_lock(path)) == -1)
+        error = errno;
+    else
+    {
+        ret = snapshot_replace(path, w, &error);
+        snapshot_unlock(lock);
+    }
+
+    if (ret != SUCCEED)
+    {
+        zabbix_log(saver.failed == 0 ? LOG_LEVEL_WARNING : LOG_LEVEL_DEBUG,
+                   "Module: %s - could not save snapshot %s: %s (%s:%d)",
+                   MODULE_NAME, path, zbx_strerror(error), __FILE__, __LINE__ );
+        saver.failed = 1;
+    }
+    else
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - saved %u records of %d bytes to %s in %.3f seconds (%s:%d)",
+                   MODULE_NAME, (unsigned int)w->count, (int)w->offset, path, zbx_time() - started,
+                   __FILE__, __LINE__ );
+    }
+
+    zbx_free(w->buffer);
+    zbx_hashset_destroy(&w->keys);
+    zbx_free(w);
+}
+
+/*
+Returns the state of this process as snapshot records, built in memory only. The caches it
+reads are not locked, so this runs in the thread that answers items.
+*/
+static struct snapshotWriter *snapshot_collect(void)
+{
+    struct snapshotWriter *w;
+    struct snapshotHeader header;
+
+    w = (struct snapshotWriter *)zbx_calloc(NULL, 1, sizeof(struct snapshotWriter));
+    zbx_hashset_create_ext(&w->keys, 256, STRING_PTR_HASH_FUNC, ZBX_DEFAULT_STRING_COMPARE_FUNC, snapshot_key_clean,
+                           ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC, ZBX_DEFAULT_MEM_FREE_FUNC);
+
+    memset(&header, 0, sizeof(header));
+    snapshot_put(w, &header, sizeof(header));
+
+    cache_snapshot_save(w);
+    discovery_snapshot_save(w);
+    request_snapshot_save(w);
+
+    return w;
+}
+
+/*
+Writes the records handed over by snapshot_save_due(), so that the item thread never waits
+for the lock or the disk.
+*/
+static void *snapshot_thread(void *args)
+{
+    struct snapshotWriter *w;
+
+    ZBX_UNUSED(args);
+
+    pthread_mutex_lock(&saver.lock);
+
+    for (;;)
+    {
+        while (saver.pending == NULL && saver.stop == 0)
+            pthread_cond_wait(&saver.wakeup, &saver.lock);
+
+        if ((w = saver.pending) == NULL)
+            break;
+
+        pthread_mutex_unlock(&saver.lock);
+        snapshot_store(w);
+        pthread_mutex_lock(&saver.lock);
+
+        saver.pending = NULL;
+    }
+
+    pthread_mutex_unlock(&saver.lock);
+
+    return NULL;
+}
+
+/*
+Starts the writer thread in the calling process, on the first save that is due. Threads do
+not survive the fork of the agent collectors.
+*/
+static void snapshot_thread_start(void)
+{
+    sigset_t mask, orig;
+
+    saver.pid = getpid();
+    saver.running = 0;
+    saver.stop = 0;
+    saver.pending = NULL;
+
+    pthread_mutex_init(&saver.lock, NULL);
+    pthread_cond_init(&saver.wakeup, NULL);
+
+    /* signals are handled by the agent process, not by the writer */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, &orig);
+
+    if (pthread_create(&saver.thread, NULL, snapshot_thread, NULL) == 0)
+        saver.running = 1;
+    else
+        zabbix_log(LOG_LEVEL_ERR, "Error in module: %s - could not start snapshot thread (%s:%d)",
+                   MODULE_NAME, __FILE__, __LINE__ );
+
+    pthread_sigmask(SIG_SETMASK, &orig, NULL);
+}
+
+/*
+Saves the snapshot once every snapshot_interval, called on every poll. The records are built
+here and written by the writer thread of the process; a save that is due while the previous
+one is still being written is skipped. The first save of a process is delayed by up to
+another interval, so that the processes forked together do not save together.
+*/
+void snapshot_save_due(void)
+{
+    struct snapshotWriter *w;
+    double now;
+
+    if (glassfishConfig.snapshotInterval == 0 || glassfishConfig.snapshotFile == NULL ||
+        *glassfishConfig.snapshotFile == '\0')
+    {
+        return;
+    }
+
+    now = zbx_time();
+
+    if (saver.pid != getpid())
+    {
+        snapshot_thread_start();
+        saver.nextSave = now + glassfishConfig.snapshotInterval + getpid() % glassfishConfig.snapshotInterval;
+        return;
+    }
+
+    if (now < saver.nextSave || saver.running == 0)
+        return;
+
+    saver.nextSave = now + glassfishConfig.snapshotInterval;
+
+    pthread_mutex_lock(&saver.lock);
+
+    if (saver.pending != NULL)
+    {
+        pthread_mutex_unlock(&saver.lock);
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s - previous snapshot still being written, skipping (%s:%d)",
+                   MODULE_NAME, __FILE__, __LINE__ );
+        return;
+    }
+
+    pthread_mutex_unlock(&saver.lock);
+
+    w = snapshot_collect();
+
+    pthread_mutex_lock(&saver.lock);
+    saver.pending = w;
+    pthread_cond_signal(&saver.wakeup);
+    pthread_mutex_unlock(&saver.lock);
+}
+
+/*
+Writes the state of this process to the snapshot, after the writer thread finished what it
+was given. Called from zbx_module_uninit, in the processes that call it.
+*/
+void snapshot_save(void)
+{
+    if (glassfishConfig.snapshotInterval == 0 || glassfishConfig.snapshotFile == NULL ||
+        *glassfishConfig.snapshotFile == '\0')
+    {
+        return;
+    }
+
+    if (saver.pid == getpid() && saver.running != 0)
+    {
+        pthread_mutex_lock(&saver.lock);
+        saver.stop = 1;
+        pthread_cond_signal(&saver.wakeup);
+        pthread_mutex_unlock(&saver.lock);
+
+        pthread_join(saver.thread, NULL);
+        pthread_cond_destroy(&saver.wakeup);
+        pthread_mutex_destroy(&saver.lock);
+        saver.running = 0;
+    }
+
+    saver.pid = 0;
+    snapshot_store(snapshot_collect());
+}
@@ -0,0 +1,383 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include "zbxjson.h"
+#include <curl/curl.h>
+#include "glassfish.h"
+
+#define STATS_LATENCY   0
+#define STATS_CONNECT   1
+#define STATS_TLS       2
+#define STATS_WAIT      3
+#define STATS_TRANSFER  4
+#define STATS_PARSE     5
+#define STATS_STAGES    6
+
+#define STATS_BUCKETS   (STATS_SUB_BUCKETS * (STATS_BUCKET_GROUPS + 1))
+
+/*
+Log-linear histogram of durations in microseconds: every power of two is split into
+STATS_SUB_BUCKETS buckets, so a percentile is off by at most 1 / STATS_SUB_BUCKETS.
+Updated with atomic adds, the collector thread records transfers concurrently.
+*/
+struct statsHistogram
+{
+    zbx_uint64_t count;
+    zbx_uint64_t sum;
+    zbx_uint64_t max;
+    zbx_uint64_t buckets[STATS_BUCKETS];
+};
+
+struct statsKey
+{
+    const char *name;
+    zbx_uint64_t requests;
+    zbx_uint64_t errors;
+    zbx_uint64_t bytes;
+    zbx_uint64_t bytesSaved;
+    struct statsHistogram stages[STATS_STAGES];
+};
+
+static const char *stageNames[STATS_STAGES] = {"latency", "connect", "tls", "wait", "transfer", "parse"};
+
+/* slot 0 belongs to the collector thread, the others are claimed by the item handlers */
+static struct statsKey statsKeys[STATS_MAX_KEYS];
+static int statsKeyCount;
+static struct statsKey *current;
+static double started;
+
+/*
+*/
+void stats_init(void)
+{
+    memset(statsKeys, 0, sizeof(statsKeys));
+    statsKeys[0].name = "collector";
+    statsKeyCount = 1;
+    current = NULL;
+}
+
+/*
+*/
+static struct statsKey *stats_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < statsKeyCount; i++)
+    {
+        if (strcmp(statsKeys[i].name, name) == 0)
+            return &statsKeys[i];
+    }
+
+    return NULL;
+}
+
+/*
+*/
+static int stats_bucket(zbx_uint64_t value)
+{
+    int exponent = 0, shift;
+
+    if (value < STATS_SUB_BUCKETS)
+        return (int)value;
+
+    while ((value >> exponent) >= 2 * STATS_SUB_BUCKETS)
+        exponent++;
+
+    if (exponent >= STATS_BUCKET_GROUPS)
+        return STATS_BUCKETS - 1;
+
+    shift = exponent + 1;
+
+    return shift * STATS_SUB_BUCKETS + (int)(value >> exponent) - STATS_SUB_BUCKETS;
+}
+
+/*
+Upper bound of the bucket, in microseconds.
+*/
+static zbx_uint64_t stats_bucket_limit(int bucket)
+{
+    int group = bucket / STATS_SUB_BUCKETS;
+
+    if (group == 0)
+        return (zbx_uint64_t)bucket + 1;
+
+    return ((zbx_uint64_t)(bucket % STATS_SUB_BUCKETS + STATS_SUB_BUCKETS) + 1) << (group - 1);
+}
+
+/*
+*/
+static void stats_record(struct statsHistogram *h, double seconds)
+{
+    zbx_uint64_t value, max;
+
+    if (seconds < 0)
+        seconds = 0;
+
+    value = (zbx_uint64_t)(seconds * 1000000);
+
+    __atomic_fetch_add(&h->buckets[stats_bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+
+    max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+    while (value > max && !__atomic_compare_exchange_n(&h->max, &max, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/*
+Starts timing an item handler. key is the item key without the "glassfish." prefix.
+*/
+void stats_begin(const char *key)
+{
+    if (NULL == (current = stats_find(key)) && statsKeyCount < STATS_MAX_KEYS)
+    {
+        current = &statsKeys[statsKeyCount];
+        current->name = key;
+        __atomic_store_n(&statsKeyCount, statsKeyCount + 1, __ATOMIC_RELEASE);
+    }
+
+    started = zbx_time();
+}
+
+/*
+Records the latency of the item handler and counts it as an error unless ret is
+SYSINFO_RET_OK. Returns ret, so that handlers can end with return stats_end(ret).
+*/
+int stats_end(int ret)
+{
+    if (current == NULL)
+        return ret;
+
+    stats_record(&current->stages[STATS_LATENCY], zbx_time() - started);
+    __atomic_fetch_add(&current->requests, 1, __ATOMIC_RELAXED);
+
+    if (ret != SYSINFO_RET_OK)
+        __atomic_fetch_add(&current->errors, 1, __ATOMIC_RELAXED);
+
+    current = NULL;
+
+    return ret;
+}
+
+/*
+Records the timing breakdown of the last transfer on handle, for the running item handler
+or, if background is set, for the collector thread. decoded is the size of the body after
+decompression, what it exceeds the bytes on the wire by is counted as saved.
+*/
+void stats_transfer(CURL *handle, int background, size_t decoded)
+{
+    struct statsKey *key = (background != 0 ? &statsKeys[0] : current);
+    double connect = 0, appConnect = 0, startTransfer = 0, total = 0;
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t received = 0;
+
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &received);
+#else
+    double received = 0;
+
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &received);
+#endif
+
+    if (key == NULL)
+        return;
+
+    curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME, &connect);
+    curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME, &appConnect);
+    curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &startTransfer);
+    curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &total);
+
+    /* a reused connection reports no connect and TLS time, that is not a sample */
+    if (connect > 0)
+        stats_record(&key->stages[STATS_CONNECT], connect);
+
+    if (appConnect > 0)
+        stats_record(&key->stages[STATS_TLS], appConnect - connect);
+
+    stats_record(&key->stages[STATS_WAIT], startTransfer - (appConnect > 0 ? appConnect : connect));
+    stats_record(&key->stages[STATS_TRANSFER], total - startTransfer);
+
+    __atomic_fetch_add(&key->bytes, (zbx_uint64_t)received, __ATOMIC_RELAXED);
+
+    if ((zbx_uint64_t)decoded > (zbx_uint64_t)received)
+        __atomic_fetch_add(&key->bytesSaved, (zbx_uint64_t)decoded - (zbx_uint64_t)received, __ATOMIC_RELAXED);
+
+    if (background != 0)
+        __atomic_fetch_add(&key->requests, 1, __ATOMIC_RELAXED);
+}
+
+/*
+Records time spent in regex matching or JSON scanning for the running item handler.
+*/
+void stats_parse(double seconds)
+{
+    if (current != NULL)
+        stats_record(&current->stages[STATS_PARSE], seconds);
+}
+
+/*
+Counts a failed background transfer.
+*/
+void stats_error(void)
+{
+    __atomic_fetch_add(&statsKeys[0].errors, 1, __ATOMIC_RELAXED);
+}
+
+/*
+Returns the upper bound of the bucket holding the given fraction of the samples, in seconds.
+*/
+static double stats_percentile(struct statsHistogram *h, double fraction)
+{
+    zbx_uint64_t count, rank, seen = 0;
+    int i;
+
+    if (0 == (count = __atomic_load_n(&h->count, __ATOMIC_RELAXED)))
+        return 0;
+
+    rank = (zbx_uint64_t)(fraction * count + 0.5);
+
+    if (rank == 0)
+        rank = 1;
+
+    for (i = 0; i < STATS_BUCKETS; i++)
+    {
+        seen += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+
+        if (seen >= rank)
+            break;
+    }
+
+    if (i == STATS_BUCKETS)
+        i--;
+
+    return (double)stats_bucket_limit(i) / 1000000;
+}
+
+/*
+*/
+static int stats_histogram_value(struct statsHistogram *h, const char *statistic, double *value)
+{
+    zbx_uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+
+    if (strcmp(statistic, "count") == 0)
+        *value = (double)count;
+    else if (strcmp(statistic, "avg") == 0)
+        *value = (count == 0 ? 0 : (double)__atomic_load_n(&h->sum, __ATOMIC_RELAXED) / count / 1000000);
+    else if (strcmp(statistic, "max") == 0)
+        *value = (double)__atomic_load_n(&h->max, __ATOMIC_RELAXED) / 1000000;
+    else if (strcmp(statistic, "p50") == 0)
+        *value = stats_percentile(h, 0.5);
+    else if (strcmp(statistic, "p90") == 0)
+        *value = stats_percentile(h, 0.9);
+    else if (strcmp(statistic, "p99") == 0)
+        *value = stats_percentile(h, 0.99);
+    else if (strcmp(statistic, "p999") == 0)
+        *value = stats_percentile(h, 0.999);
+    else
+        return FAIL;
+
+    return SUCCEED;
+}
+
+/*
+Returns the address of a counter of key, or NULL if metric is not a counter.
+*/
+static zbx_uint64_t *stats_counter(struct statsKey *key, const char *metric)
+{
+    if (strcmp(metric, "requests") == 0)
+        return &key->requests;
+
+    if (strcmp(metric, "errors") == 0)
+        return &key->errors;
+
+    if (strcmp(metric, "bytes") == 0)
+        return &key->bytes;
+
+    if (strcmp(metric, "bytes_saved") == 0)
+        return &key->bytesSaved;
+
+    return NULL;
+}
+
+/*
+Looks a value up for glassfish.stats[metric,statistic,key]. metric is a stage name, with
+count, avg, max, p50, p90, p99 or p999 as statistic, or one of the counters "requests",
+"errors", "bytes" received on the wire and "bytes_saved" by compression.
+*/
+int stats_get(const char *metric, const char *statistic, const char *key, double *value)
+{
+    struct statsKey *found, empty;
+    zbx_uint64_t *counter;
+    int i;
+
+    if (NULL == (found = stats_find(key)))
+    {
+        *value = 0;
+        return (stats_counter(&empty, metric) != NULL ? SUCCEED : FAIL);
+    }
+
+    if (NULL != (counter = stats_counter(found, metric)))
+    {
+        *value = (double)__atomic_load_n(counter, __ATOMIC_RELAXED);
+        return SUCCEED;
+    }
+
+    for (i = 0; i < STATS_STAGES; i++)
+    {
+        if (strcmp(metric, stageNames[i]) == 0)
+            return stats_histogram_value(&found->stages[i], statistic, value);
+    }
+
+    return FAIL;
+}
+
+/*
+Dumps counters and percentiles of every key of this process as one JSON object.
+*/
+char *stats_json(void)
+{
+    static const char *statistics[] = {"count", "avg", "max", "p50", "p90", "p99", "p999", NULL};
+    struct zbx_json j;
+    double value;
+    char *data;
+    int i, stage, count, s;
+
+    count = __atomic_load_n(&statsKeyCount, __ATOMIC_ACQUIRE);
+
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+
+    for (i = 0; i < count; i++)
+    {
+        zbx_json_addobject(&j, statsKeys[i].name);
+        zbx_json_adduint64(&j, "requests", __atomic_load_n(&statsKeys[i].requests, __ATOMIC_RELAXED));
+        zbx_json_adduint64(&j, "errors", __atomic_load_n(&statsKeys[i].errors, __ATOMIC_RELAXED));
+        zbx_json_adduint64(&j, "bytes", __atomic_load_n(&statsKeys[i].bytes, __ATOMIC_RELAXED));
+        zbx_json_adduint64(&j, "bytes_saved", __atomic_load_n(&statsKeys[i].bytesSaved, __ATOMIC_RELAXED));
+
+        for (stage = 0; stage < STATS_STAGES; stage++)
+        {
+            zbx_json_addobject(&j, stageNames[stage]);
+
+            for (s = 0; statistics[s] != NULL; s++)
+            {
+                stats_histogram_value(&statsKeys[i].stages[stage], statistics[s], &value);
+
+                if (s == 0)
+                    zbx_json_adduint64(&j, statistics[s], (zbx_uint64_t)value);
+                else
+                    zbx_json_addfloat(&j, statistics[s], value);
+            }
+
+            zbx_json_close(&j);
+        }
+
+        zbx_json_close(&j);
+    }
+
+    data = zbx_strdup(NULL, j.buffer);
+    zbx_json_free(&j);
+
+    return data;
+}
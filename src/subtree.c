@@ -0,0 +1,56 @@
+#include "sysinc.h"
+#include "module.h"
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include <curl/curl.h>
+#include "glassfish.h"
+
+/*
+Monitoring subtrees below GLASSFISH_MONITORING that glassfish.stat answers from. Each is
+fetched once per interval with the depth given and flattened into a bulk index, so all
+glassfish.stat items of one subtree share one request:
+
+    jvm             memory, garbage-collectors, thread-system, class-loading-system, runtime
+    network         thread-pool, connection-queue, keep-alive and file-cache per listener
+    orb             transport/connectioncache
+    applications    web modules, servlets and the EJB containers: bean-pool, bean-cache, bean-methods
+    resources       connection pools, shared with glassfish.resource
+    http-service    virtual servers and their requests
+*/
+static const struct monitoringSubtree subtrees[] =
+{
+    {"jvm",             4},
+    {"network",         3},
+    {"orb",             4},
+    {"applications",    BULK_DEPTH},
+    {"resources",       BULK_DEPTH},
+    {"http-service",    BULK_DEPTH},
+    {NULL}
+};
+
+/*
+Finds the subtree a glassfish.stat path starts with. The path is the node below the subtree,
+its names separated by "/", then the statistic and the field, e.g.
+"jvm/memory.usedheapsize-count.count". *indexKey is set to the rest of the path, the key of
+the value in the bulk index of the subtree. Returns NULL if no subtree matches.
+*/
+const struct monitoringSubtree *subtree_find(const char *path, const char **indexKey)
+{
+    const struct monitoringSubtree *subtree;
+    size_t length;
+
+    for (subtree = subtrees; subtree->name != NULL; subtree++)
+    {
+        length = strlen(subtree->name);
+
+        if (strncmp(path, subtree->name, length) == 0 && (path[length] == '/' || path[length] == '.') &&
+            path[length + 1] != '\0')
+        {
+            *indexKey = path + length + 1;
+            return subtree;
+        }
+    }
+
+    return NULL;
+}